@@ -0,0 +1,382 @@
+#include <roerei/cpp14_fix.hpp>
+
+#include <roerei/dataset.hpp>
+#include <roerei/dependencies.hpp>
+#include <roerei/distance.hpp>
+#include <roerei/performance.hpp>
+#include <roerei/storage.hpp>
+#include <roerei/synthetic.hpp>
+
+#include <roerei/generic/compact_sparse_matrix.hpp>
+#include <roerei/generic/full_unit_matrix.hpp>
+#include <roerei/generic/multitask.hpp>
+#include <roerei/generic/set_operations.hpp>
+#include <roerei/generic/sliced_sparse_matrix.hpp>
+
+#include <roerei/ml/adarank.hpp>
+#include <roerei/ml/naive_bayes.hpp>
+#include <roerei/ml/posetcons_canonical.hpp>
+#include <roerei/ml/posetcons_optimistic.hpp>
+#include <roerei/ml/posetcons_pessimistic.hpp>
+
+#include <roerei/util/performance.hpp>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::atomic<size_t> roerei::multitask::jobset_t::jobset_count(0);
+
+namespace roerei
+{
+
+/* Micro-benchmarks of the hot kernels.
+ * Every benchmark repeats a single operation until it has run for at least min_time, doubling
+ * the number of iterations, and reports the last run as a JSON line on stdout:
+ *   {"benchmark":..., "dataset":..., "iterations":..., "ns_per_op":..., "ops_per_sec":..., "items_per_sec":...}
+ * where an item is the unit of work of the operation (nonzeros, objects, ...).
+ */
+class bench
+{
+private:
+	bench() = delete;
+
+	typedef std::chrono::steady_clock clock;
+	typedef compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> compact_t;
+	typedef adarank::document_id_t document_id_t;
+
+	struct options_t
+	{
+		std::string filter;
+		double min_time;
+	};
+
+	// Silences the progress printed to std::cout by the predictors, which is reserved for the results
+	class quiet_t
+	{
+	private:
+		std::streambuf* const buf;
+
+	public:
+		quiet_t()
+			: buf(std::cout.rdbuf(nullptr))
+		{}
+
+		~quiet_t()
+		{
+			std::cout.rdbuf(buf);
+		}
+	};
+
+	template<typename F>
+	static void run(options_t const& opt, std::string const& name, std::string const& dataset, double items_per_op, F const& f)
+	{
+		if(name.find(opt.filter) == std::string::npos)
+			return;
+
+		volatile float sink = 0.0f; // Keeps the results of f alive
+		f(0); // Warm up
+
+		size_t iterations = 1;
+		double elapsed = 0.0;
+		while(true)
+		{
+			auto const start = clock::now();
+			for(size_t i = 0; i < iterations; ++i)
+				sink = sink + f(i);
+			elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+			if(elapsed >= opt.min_time || iterations >= (size_t(1) << 40))
+				break;
+
+			iterations *= 2;
+		}
+
+		double const ns_per_op = elapsed * 1e9 / iterations;
+		double const ops_per_sec = iterations / elapsed;
+		std::cout
+			<< "{\"benchmark\":\"" << name << "\",\"dataset\":\"" << dataset << "\""
+			<< ",\"iterations\":" << iterations
+			<< ",\"ns_per_op\":" << ns_per_op
+			<< ",\"ops_per_sec\":" << ops_per_sec
+			<< ",\"items_per_sec\":" << ops_per_sec * items_per_op
+			<< "}" << std::endl;
+	}
+
+	static size_t nonempty_size(compact_t const& m)
+	{
+		size_t n = 0;
+		m.citerate([&](compact_t::const_row_proxy_t const& row) {
+			n += row.nonempty_size();
+		});
+		return n;
+	}
+
+	static void run_distance(options_t const& opt, std::string const& name, dataset_t const& d, compact_t const& m)
+	{
+		size_t const rows = d.objects.size();
+		double const items = 2.0 * nonempty_size(m) / rows;
+
+		run(opt, "distance::euclidean", name, items, [&](size_t i) {
+			auto const xs(m[object_id_t(i % rows)]);
+			auto const ys(m[object_id_t((i * 7919 + 1) % rows)]);
+			return distance::euclidean<dataset_t::value_t, decltype(xs), decltype(ys)>(xs, ys);
+		});
+	}
+
+	static void run_set_operations(options_t const& opt, std::string const& name, dataset_t const& d, nb_preload_data_t const& pld)
+	{
+		// Pairs of occurrence lists of the features, as intersected by naive_bayes
+		std::vector<std::pair<std::vector<object_id_t> const*, std::vector<object_id_t> const*>> pairs;
+		std::mt19937 gen(1337);
+		std::uniform_int_distribution<size_t> f_dis(0, d.features.size()-1);
+		for(size_t i = 0; i < 1024; ++i)
+			pairs.emplace_back(&pld.feature_occurance[feature_id_t(f_dis(gen))], &pld.feature_occurance[feature_id_t(f_dis(gen))]);
+
+		double items = 0.0;
+		for(auto const& p : pairs)
+			items += p.first->size() + p.second->size();
+		items /= pairs.size();
+
+		run(opt, "set_compute_intersect", name, items, [&](size_t i) {
+			auto const& p = pairs[i % pairs.size()];
+			size_t c = 0;
+			set_compute_intersect(p.first->begin(), p.first->end(), p.second->begin(), p.second->end(),
+				[](object_id_t x) { return x; }, [](object_id_t x) { return x; },
+				[&](object_id_t, object_id_t) { c++; });
+			return static_cast<float>(c);
+		});
+
+		run(opt, "set_smart_intersect", name, items, [&](size_t i) {
+			auto const& p = pairs[i % pairs.size()];
+			size_t c = 0;
+			set_smart_intersect(*p.first, *p.second, [&](object_id_t) { c++; });
+			return static_cast<float>(c);
+		});
+	}
+
+	static void run_naive_bayes(options_t const& opt, std::string const& name, dataset_t const& d, nb_preload_data_t const& pld, compact_t const& m)
+	{
+		naive_bayes<compact_t> const ml(10, -15, 0, d, pld, m);
+
+		size_t const rows = d.objects.size();
+		if(rows == 0)
+			return;
+
+		// Ranks every allowed dependency of the row
+		run(opt, "naive_bayes::predict", name, 1.0, [&](size_t i) {
+			object_id_t const row_id((i * 7919) % rows);
+			return static_cast<float>(ml.predict(m[row_id], row_id).size());
+		});
+	}
+
+	static void run_adarank(options_t const& opt, std::string const& name, dataset_t const& d, compact_t const& m)
+	{
+		std::unique_ptr<adarank> ml;
+		{
+			quiet_t q;
+			ml.reset(new adarank(1, d, m));
+		}
+
+		adarank::feature_buffers_t buffers;
+		size_t const rows = d.objects.size(), documents = d.dependencies.size();
+		run(opt, "adarank::compute_features", name, 1.0, [&](size_t i) {
+			document_id_t const d_id((i * 7919) % documents);
+			auto const features(ml->fold_features(d_id, m[object_id_t(i % rows)], buffers));
+			return features[0];
+		});
+	}
+
+	/* Lookups of rows which are not in the trainingset of a fold, as done for the documents of adarank
+	 * and the whitelists of the optimistic strategy; every fourth object is in the test fold.
+	 */
+	static void run_fold(options_t const& opt, std::string const& name, dataset_t const& d)
+	{
+		sliced_sparse_matrix_t<dataset_t::feature_matrix_t const> train_tmp(d.feature_matrix, false);
+		d.objects.keys([&](object_id_t i) {
+			if(i.unseal() % 4 != 0)
+				train_tmp.add_key(i);
+		});
+		compact_t const train_m(train_tmp);
+
+		size_t const rows = d.objects.size();
+		run(opt, "adarank::create_dqs", name, rows, [&](size_t) {
+			return static_cast<float>(adarank::create_dqs(d, train_m).size_m());
+		});
+
+		if(rows > max_transitive_objects)
+			return;
+
+		auto run_posetcons = [&](std::string const& benchmark, auto const& pc) {
+			run(opt, benchmark, name, 1.0, [&](size_t i) {
+				size_t nonempty = 0;
+				pc.exec(train_m, object_id_t(i % rows)).citerate([&](compact_t::const_row_proxy_t const& row) {
+					nonempty += row.nonempty_size();
+				});
+				return static_cast<float>(nonempty);
+			});
+		};
+
+		if(std::string("posetcons_optimistic::citerate").find(opt.filter) != std::string::npos)
+			run_posetcons("posetcons_optimistic::citerate", posetcons_optimistic(d));
+		if(std::string("posetcons_pessimistic::citerate").find(opt.filter) != std::string::npos)
+			run_posetcons("posetcons_pessimistic::citerate", posetcons_pessimistic(d));
+	}
+
+	static void run_measure(options_t const& opt, std::string const& name, dataset_t const& d)
+	{
+		std::mt19937 gen(1337);
+		std::uniform_real_distribution<float> score_dis(0.0f, 1.0f);
+
+		// Scored suggestions of every dependency, as produced by the predictors
+		std::vector<std::pair<dependency_id_t, float>> suggestions;
+		d.dependencies.keys([&](dependency_id_t i) {
+			suggestions.emplace_back(i, score_dis(gen));
+		});
+
+		size_t const rows = d.objects.size();
+		run(opt, "performance::measure", name, suggestions.size(), [&](size_t i) {
+			return performance::measure(d, object_id_t(i % rows), suggestions).metrics.rank;
+		});
+
+		performance::measure_buffer_t buffer(d);
+		run(opt, "performance::measure_metrics", name, suggestions.size(), [&](size_t i) {
+			return performance::measure_metrics(d, object_id_t(i % rows), suggestions, buffer).rank;
+		});
+	}
+
+	static void run_transitive(options_t const& opt, std::string const& name, dataset_t const& d)
+	{
+		run(opt, "dataset_t::create_dependency_map", name, d.dependencies.size(), [&](size_t) {
+			return static_cast<float>(d.create_dependency_map().size());
+		});
+
+		if(d.objects.size() > max_transitive_objects)
+			return;
+
+		auto const dependants(dependencies::create_obj_dependants(d));
+		run(opt, "full_unit_matrix_t::transitive", name, d.objects.size(), [&](size_t) {
+			auto m(dependants);
+			m.transitive();
+			return static_cast<float>(m[std::make_pair(object_id_t(0), object_id_t(0))]);
+		});
+	}
+
+	static void run_compact(options_t const& opt, std::string const& name, dataset_t const& d, compact_t const& m)
+	{
+		run(opt, "compact_sparse_matrix_t::construct", name, nonempty_size(m), [&](size_t) {
+			compact_t const c(d.feature_matrix);
+			return static_cast<float>(c.size_m());
+		});
+
+		// The trainingset of the canonical strategy, for test rows spread over the whole corpus
+		size_t const rows = d.objects.size();
+		run(opt, "split_sparse_matrix_t::citerate", name, 1.0, [&](size_t i) {
+			size_t nonempty = 0;
+			posetcons_canonical::exec(m, m[object_id_t((i * 7919) % rows)]).citerate([&](compact_t::const_row_proxy_t const& row) {
+				nonempty += row.nonempty_size();
+			});
+			return static_cast<float>(nonempty);
+		});
+	}
+
+	// The dense closure takes about a second for 1000 objects, and grows faster than quadratically
+	static constexpr size_t max_transitive_objects = 2000;
+
+public:
+	static void exec(std::string const& name, dataset_t const& d_orig, options_t const& opt)
+	{
+		std::cerr << "Benchmarking " << name << " (" << d_orig.objects.size() << " objects)" << std::endl;
+
+		auto const d(posetcons_canonical::consistentize(d_orig));
+		compact_t const m(d.feature_matrix);
+		nb_preload_data_t const pld(d);
+
+		run_distance(opt, name, d, m);
+		run_set_operations(opt, name, d, pld);
+		run_naive_bayes(opt, name, d, pld, m);
+		run_adarank(opt, name, d, m);
+		run_fold(opt, name, d);
+		run_measure(opt, name, d);
+		run_transitive(opt, name, d);
+		run_compact(opt, name, d, m);
+	}
+
+	static int main(int argc, char** argv)
+	{
+		options_t opt{"", 0.5};
+		std::string sizes = "1000,10000", corpii;
+		float features_per_row = 8.0f;
+
+		boost::program_options::options_description o_general("Options");
+		o_general.add_options()
+				("help,h", "display this message")
+				("filter,f", boost::program_options::value(&opt.filter), "run only the benchmarks of which the name contains the filter string")
+				("min-time,t", boost::program_options::value(&opt.min_time), "minimal duration of every benchmark in seconds (default: 0.5)")
+				("sizes,n", boost::program_options::value(&sizes), "numbers of objects of the synthetic datasets, comma separated (default: 1000,10000)")
+				("features-per-row,p", boost::program_options::value(&features_per_row), "mean number of features of a synthetic object (default: 8)")
+				("corpii,c", boost::program_options::value(&corpii), "datasets in ./data to benchmark, comma separated (default: all available samples)");
+
+		boost::program_options::variables_map vm;
+		boost::program_options::store(boost::program_options::parse_command_line(argc, argv, o_general), vm);
+		boost::program_options::notify(vm);
+
+		if(vm.count("help"))
+		{
+			std::cout << "Usage: ./roerei-bench [options]" << std::endl << std::endl << o_general;
+			return EXIT_FAILURE;
+		}
+
+		std::vector<std::string> corpii_arr;
+		if(!vm.count("corpii"))
+		{
+			for(std::string corpus : {"Coq", "CoRN", "ch2o", "mathcomp", "MathClasses"})
+				for(std::string variant : {"frequency", "depth", "flat"})
+					if(boost::filesystem::exists("./data/" + corpus + ".sample." + variant + ".msgpack"))
+						corpii_arr.emplace_back(corpus + ".sample." + variant);
+		}
+		else if(!corpii.empty())
+			boost::algorithm::split(corpii_arr, corpii, boost::algorithm::is_any_of(","));
+
+		std::vector<std::string> sizes_arr;
+		if(!sizes.empty())
+			boost::algorithm::split(sizes_arr, sizes, boost::algorithm::is_any_of(","));
+
+		test::performance::init();
+
+		for(auto const& size : sizes_arr)
+		{
+			synthetic::params_t params;
+			params.objects = std::stoul(size);
+			params.features = std::max<size_t>(params.objects / 2, 1);
+			params.features_per_object = features_per_row;
+
+			std::stringstream ss;
+			ss << "synthetic-" << params.objects << "x" << features_per_row;
+			exec(ss.str(), synthetic::generate(params), opt);
+		}
+
+		for(auto const& corpus : corpii_arr)
+			exec(corpus, storage::read_dataset(corpus), opt);
+
+		test::performance::clear();
+
+		return EXIT_SUCCESS;
+	}
+};
+
+}
+
+int main(int argc, char** argv)
+{
+	return roerei::bench::main(argc, argv);
+}
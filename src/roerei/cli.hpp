@@ -12,10 +12,14 @@ private:
 	static void exec_inspect(cli_options& opt);
 	static void exec_measure(cli_options& opt);
 	static void exec_generate(cli_options& opt);
+	static void exec_append(cli_options& opt);
 	static void exec_report(cli_options& opt);
 	static void exec_export(cli_options& opt);
 	static void exec_diff(cli_options& opt);
 	static void exec_upgrade(cli_options& opt);
+	static void exec_report_perf(cli_options& opt);
+	static void exec_synthesize(cli_options& opt);
+	static void exec_serve(cli_options& opt);
 
 public:
 	cli() = delete;
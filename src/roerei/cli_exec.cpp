@@ -9,6 +9,20 @@
 #include <roerei/legacy.hpp>
 #include <roerei/diff.hpp>
 #include <roerei/exporter.hpp>
+#include <roerei/trace.hpp>
+#include <roerei/perf_reporter.hpp>
+#include <roerei/synthetic.hpp>
+#include <roerei/server.hpp>
+
+#include <roerei/util/events.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string/join.hpp>
+
+#include <chrono>
+#include <future>
+#include <utility>
+#include <vector>
 
 namespace roerei
 {
@@ -21,12 +35,19 @@ int cli::exec(int argc, char** argv)
 	if(rv != EXIT_SUCCESS)
 		return rv;
 
+	if(opt.events)
+		events::open(*opt.events);
+
+	storage::set_io_threads(opt.io_jobs);
+
 	if(opt.action == "inspect")
 		exec_inspect(opt);
 	else if(opt.action == "measure")
 		exec_measure(opt);
 	else if(opt.action == "generate")
 		exec_generate(opt);
+	else if(opt.action == "append")
+		exec_append(opt);
 	else if(opt.action == "report")
 		exec_report(opt);
 	else if(opt.action == "export")
@@ -35,6 +56,12 @@ int cli::exec(int argc, char** argv)
 		exec_diff(opt);
 	else if(opt.action == "upgrade")
 		exec_upgrade(opt);
+	else if(opt.action == "report-perf")
+		exec_report_perf(opt);
+	else if(opt.action == "synthesize")
+		exec_synthesize(opt);
+	else if(opt.action == "serve")
+		exec_serve(opt);
 	else if(opt.action == "legacy-export")
 	{
 		auto const d(storage::read_dataset("CoRN-legacy"));
@@ -56,34 +83,90 @@ int cli::exec(int argc, char** argv)
 
 void cli::exec_generate(cli_options& /*opt*/)
 {
-	auto generate = [](generator::variant_e variant, std::string postfix) {
+	// The datasets of a variant are written while the next variant is generated
+	std::vector<std::pair<std::string, std::future<void>>> pending;
+	auto wait = [&]() {
+		for(auto& kvp : pending)
+		{
+			kvp.second.get();
+			std::cerr << "Written " << kvp.first << std::endl;
+		}
+		pending.clear();
+	};
+
+	auto generate = [&](generator::variant_e variant, std::string postfix) {
 		std::map<std::string, dataset_t> map(generator::construct_from_repo(variant));
-		for(auto const& kvp : map)
+		wait();
+
+		for(auto& kvp : map)
 		{
 			auto name = kvp.first+"."+postfix;
-			storage::write_dataset(name, kvp.second);
-			std::cerr << "Written " << name << std::endl;
+			auto sample_name = kvp.first+".sample."+postfix;
+			dataset_t d_sample(sampler::sample(kvp.second));
 
-            auto sample_name = kvp.first+".sample."+postfix;
-            dataset_t d_sample(sampler::sample(kvp.second));
-            storage::write_dataset(sample_name, d_sample);
-            std::cerr << "Written " << sample_name << std::endl;
+			pending.emplace_back(name, storage::write_dataset_async(name, std::move(kvp.second)));
+			pending.emplace_back(sample_name, storage::write_dataset_async(sample_name, std::move(d_sample)));
 		}
 	};
 
 	generate(generator::variant_e::frequency, "frequency");
 	generate(generator::variant_e::depth, "depth");
 	generate(generator::variant_e::flat, "flat");
+	wait();
+}
+
+void cli::exec_append(cli_options& opt)
+{
+	if(opt.args.size() != 2)
+		throw std::runtime_error("Incorrect number of arguments for append");
+
+	// Datasets are named <corpus>.<variant> by generate
+	std::string const& name = opt.args[0];
+	auto const dot = name.rfind('.');
+	if(dot == std::string::npos)
+		throw std::runtime_error("Dataset " + name + " is not named after its corpus and variant");
+
+	std::string const corpus = name.substr(0, dot);
+	std::string const postfix = name.substr(dot + 1);
+
+	// Samples are named <corpus>.sample.<variant>; appending all new objects would not be a sample anymore
+	static std::string const sample_postfix = ".sample";
+	if(corpus.size() >= sample_postfix.size() && corpus.compare(corpus.size() - sample_postfix.size(), sample_postfix.size(), sample_postfix) == 0)
+		throw std::runtime_error("Dataset " + name + " is a sample; append to the full dataset and generate again instead");
+
+	generator::variant_e variant;
+	if(postfix == "frequency")
+		variant = generator::variant_e::frequency;
+	else if(postfix == "depth")
+		variant = generator::variant_e::depth;
+	else if(postfix == "flat")
+		variant = generator::variant_e::flat;
+	else
+		throw std::runtime_error("Unknown variant " + postfix);
+
+	std::map<uri_t, uri_t> mapping;
+	storage::read_mapping([&](mapping_t&& m) {
+		mapping.emplace(std::move(m.src), std::move(m.dest));
+	});
+
+	std::vector<summary_t> summaries;
+	storage::read_summaries([&](summary_t&& s) {
+		if(s.corpus == corpus)
+			summaries.emplace_back(std::move(s));
+	}, opt.args[1]);
+
+	auto d(storage::read_dataset(name));
+	size_t const first = generator::append(d, std::move(summaries), mapping, variant).unseal();
+	storage::write_dataset(name, d);
+	std::cerr << "Written " << name << " (" << d.objects.size() - first << " objects appended)" << std::endl;
 }
 
 void cli::exec_inspect(cli_options& opt)
 {
-	for(auto&& corpus : opt.corpii)
+	storage::iterate_datasets(opt.corpii, [&](std::string const&, dataset_t&& d) {
 		for(auto&& method : opt.methods)
-		{
-			auto const d(storage::read_dataset(corpus));
 			inspector::iterate_all(method, d, opt.filter);
-		}
+	});
 }
 
 void cli::exec_report(cli_options& opt)
@@ -115,17 +198,86 @@ void cli::exec_diff(cli_options& opt)
 
 void cli::exec_measure(cli_options& opt)
 {
+	auto const start = std::chrono::steady_clock::now();
 	multitask m;
 
-	for(auto&& corpus : opt.corpii) {
+	// Outlives the jobsets, such that all traces are written before returning
+	std::unique_ptr<trace::sink_t> trace_sink;
+	if(opt.trace)
+	{
+		boost::filesystem::create_directories(*opt.trace);
+		trace_sink.reset(new trace::sink_t());
+	}
+
+	// Every corpus is read once, while the previous one is being scheduled
+	storage::iterate_datasets(opt.corpii, [&](std::string const& corpus, dataset_t&& d) {
 		for(auto&& strat : opt.strats) {
 			for(auto&& method : opt.methods) {
-        tester::order(m, corpus, strat, method, opt.prior, opt.silent, opt.cv);
+        tester::order(m, corpus, d, strat, method, opt.prior, opt.silent, opt.cv, 1337, opt.jobs, trace_sink.get(), opt.trace ? *opt.trace : std::string());
 			}
 		}
-	}
+	});
 
 	m.run(opt.jobs, true); // Blocking
+	if(trace_sink)
+		trace_sink->flush();
+	storage::results().flush();
+	storage::fold_results().flush();
+
+	if(!opt.silent)
+		test::performance::report_merged();
+
+	test::performance::iterate_merged([](std::vector<std::string> const& path, test::performance::counters_t const& c) {
+		if(c.count == 0)
+			return;
+
+		events::emit(events::event_t("profile")("scope", boost::algorithm::join(path, "/"))
+			("count", c.count)("total_ns", c.total)("min_ns", c.min)("max_ns", c.max));
+	});
+
+	events::emit(events::event_t("measure_end")
+		("duration", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+		("peak_rss_kb", events::peak_rss_kb()));
+}
+
+void cli::exec_synthesize(cli_options& opt)
+{
+	if(opt.args.size() != 1)
+		throw std::runtime_error("Incorrect number of arguments for synthesize");
+
+	auto const d(synthetic::generate(opt.synthetic_params));
+	storage::write_dataset(opt.args[0], d);
+	std::cerr << "Written " << opt.args[0] << " (" << d.objects.size() << " objects, " << d.features.size() << " features)" << std::endl;
+}
+
+void cli::exec_serve(cli_options& opt)
+{
+	if(opt.args.size() != 1)
+		throw std::runtime_error("Incorrect number of arguments for serve");
+
+	server::options_t server_opt;
+	server_opt.ml = opt.methods.front();
+	server_opt.threads = opt.jobs;
+	server_opt.batch_size = std::max<size_t>(1, opt.batch_size);
+
+	std::cerr << "Loading " << opt.args[0] << " for " << to_string(server_opt.ml) << std::endl;
+	server s(storage::read_dataset(opt.args[0]), server_opt);
+	std::cerr << "Ready" << std::endl;
+
+	if(opt.socket)
+		s.serve_socket(*opt.socket);
+	else
+		s.serve(std::cin, std::cout);
+
+	std::cerr << s.stats() << std::endl;
+}
+
+void cli::exec_report_perf(cli_options& opt)
+{
+	if(opt.args.size() != 1)
+		throw std::runtime_error("Incorrect number of arguments for report-perf");
+
+	perf_reporter::exec(opt.args[0]);
 }
 
 void cli::exec_export(cli_options& opt)
@@ -190,6 +342,7 @@ void cli::exec_upgrade(cli_options& opt)
 			std::cout << "Wrote " << result << std::endl;
 			storage::write_result(result);
 		}
+		storage::results().flush();
 	}
 }
 
@@ -7,6 +7,7 @@
 
 #include <roerei/ml/ml_type.hpp>
 #include <roerei/ml/posetcons_type.hpp>
+#include <roerei/synthetic.hpp>
 
 namespace roerei
 {
@@ -23,6 +24,12 @@ struct cli_options
 	bool prior = true;
 	bool cv = true;
 	size_t jobs = 1;
+	size_t io_jobs = 2;
+	boost::optional<std::string> trace;
+	boost::optional<std::string> events;
+	synthetic::params_t synthetic_params;
+	boost::optional<std::string> socket;
+	size_t batch_size = 16;
 };
 
 }
@@ -12,7 +12,7 @@ namespace roerei
 
 int cli::read_options(cli_options& opt, int argc, char** argv)
 {
-	std::string corpii, methods, strats, filter;
+	std::string corpii, methods, strats, filter, trace, events, socket;
 
 	boost::program_options::options_description o_general("Options");
 	o_general.add_options()
@@ -24,7 +24,24 @@ int cli::read_options(cli_options& opt, int argc, char** argv)
 			("methods,m", boost::program_options::value(&methods), "select which methods to use, possibly comma separated (default: all)")
 			("strats,r", boost::program_options::value(&strats), "select which poset consistency strategies to use, possibly comma separated (default: all)")
 			("jobs,j", boost::program_options::value(&opt.jobs), "number of concurrent jobs (default: 1)")
-			("filter,f", boost::program_options::value(&filter), "show only objects which include the filter string");
+			("io-jobs", boost::program_options::value(&opt.io_jobs), "number of datasets read or written concurrently (default: 2)")
+			("trace,t", boost::program_options::value(&trace), "write the results of every test row of measure to a trace per jobset in directory <arg>")
+			("events,e", boost::program_options::value(&events), "write progress and profiling events as JSON lines to file <arg> (or /dev/fd/<n>)")
+			("filter,f", boost::program_options::value(&filter), "show only objects which include the filter string")
+			("socket", boost::program_options::value(&socket), "serve on Unix domain socket <arg> instead of stdin/stdout")
+			("batch", boost::program_options::value(&opt.batch_size), "maximal number of requests which serve answers at once (default: 16)");
+
+	boost::program_options::options_description o_synthetic("Synthetic corpus options");
+	o_synthetic.add_options()
+			("objects", boost::program_options::value(&opt.synthetic_params.objects), "number of objects (default: 10000)")
+			("features", boost::program_options::value(&opt.synthetic_params.features), "number of distinct features (default: 5000)")
+			("features-per-object", boost::program_options::value(&opt.synthetic_params.features_per_object), "mean number of feature occurrences of an object (default: 8)")
+			("feature-exponent", boost::program_options::value(&opt.synthetic_params.exponent), "exponent of the power-law distribution of the feature frequencies (default: 1.1)")
+			("inherit", boost::program_options::value(&opt.synthetic_params.inherit), "fraction of the features of an object taken from its dependencies (default: 0.5)")
+			("depth", boost::program_options::value(&opt.synthetic_params.depth), "number of layers of the dependency graph (default: 20)")
+			("fan-out", boost::program_options::value(&opt.synthetic_params.fan_out), "mean number of dependencies of an object (default: 4)")
+			("prior", boost::program_options::value(&opt.synthetic_params.prior), "fraction of the objects which are prior objects (default: 0.1)")
+			("seed", boost::program_options::value(&opt.synthetic_params.seed), "seed of the synthetic corpus (default: 1337)");
 
 	boost::program_options::variables_map vm;
 	boost::program_options::positional_options_description pos;
@@ -34,6 +51,7 @@ int cli::read_options(cli_options& opt, int argc, char** argv)
 
 	boost::program_options::options_description options("Allowed options");
 	options.add(o_general);
+	options.add(o_synthetic);
 	options.add_options()
 			("action", boost::program_options::value(&opt.action))
 			("args", boost::program_options::value(&opt.args));
@@ -64,16 +82,22 @@ int cli::read_options(cli_options& opt, int argc, char** argv)
 				<< std::endl
 				<< "Actions:" << std::endl
 				<< "  generate                 load repo.msgpack, convert and write to dataset.msgpack" << std::endl
+				<< "  append <dataset> <repo>  append the new objects of summaries file 'repo' to dataset 'dataset'" << std::endl
 				<< "  inspect                  inspect all objects" << std::endl
 				<< "  measure                  run all scheduled tests and store the results" << std::endl
 				<< "  report [results]         report on all results [in file 'results']" << std::endl
 				<< "  diff <c1> <c2>           show the difference between two corpii" << std::endl
 				<< "  export [results] <dest>  dump all results [from file 'results-path'] into predefined format for thesis in directory <path>" << std::endl
 				<< "  upgrade <src>						 upgrade non-prior results dataset to newest version" << std::endl
+				<< "  report-perf <events>     summarize the throughput and profile in event stream 'events'" << std::endl
+				<< "  synthesize <corpus>      generate a synthetic dataset and write it as corpus 'corpus'" << std::endl
+				<< "  serve <corpus>           answer premise selection queries on corpus 'corpus' with the first method" << std::endl
 				<< "  legacy-export            export dataset in the legacy format" << std::endl
 				<< "  legacy-import            import dataset in the legacy format" << std::endl
 				<< std::endl
-				<< o_general;
+				<< o_general
+				<< std::endl
+				<< o_synthetic;
 
 		return EXIT_FAILURE;
 	}
@@ -137,6 +161,21 @@ int cli::read_options(cli_options& opt, int argc, char** argv)
 		opt.filter = filter;
 	}
 
+	if(vm.count("trace"))
+	{
+		opt.trace = trace;
+	}
+
+	if(vm.count("events"))
+	{
+		opt.events = events;
+	}
+
+	if(vm.count("socket"))
+	{
+		opt.socket = socket;
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -82,6 +82,14 @@ struct cv_result_v2_t
 
 typedef cv_result_v2_t cv_result_t;
 
+// The metrics of a single fold of a crossvalidation, checkpointed until all folds are done
+struct cv_fold_result_t
+{
+  cv_result_t result;
+  uint64_t seed, fingerprint; // Of the partition, and of the dataset it partitions
+  size_t fold;
+};
+
 inline bool operator==(cv_result_t const& lhs, cv_result_t const& rhs)
 {
   return
@@ -166,4 +174,12 @@ BOOST_FUSION_ADAPT_STRUCT(
   (size_t, n)
   (size_t, k)
   (roerei::performance::metrics_t, metrics)
-)
\ No newline at end of file
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  roerei::cv_fold_result_t,
+  (roerei::cv_result_t, result)
+  (uint64_t, seed)
+  (uint64_t, fingerprint)
+  (size_t, fold)
+)
@@ -8,9 +8,11 @@
 #include <roerei/generic/id_t.hpp>
 
 #include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/optional.hpp>
 
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 namespace roerei
 {
@@ -18,6 +20,7 @@ namespace roerei
 struct dataset_t
 {
 	typedef uint16_t value_t;
+	static_assert(sizeof(std::pair<feature_id_t, value_t>) == 8, "Sparse entries should be packed in 8 bytes");
 	typedef sparse_matrix_t<object_id_t, feature_id_t, value_t> feature_matrix_t;
 	typedef sparse_matrix_t<object_id_t, dependency_id_t, value_t> dependency_matrix_t;
 
@@ -29,6 +32,10 @@ struct dataset_t
 
 	std::set<object_id_t> prior_objects;
 
+	// The object with the same uri as a dependency, and vice versa; not serialized, but derived by index_uris
+	encapsulated_vector<dependency_id_t, boost::optional<object_id_t>> dependency_objects;
+	encapsulated_vector<object_id_t, boost::optional<dependency_id_t>> object_dependencies;
+
 public:
 	dataset_t(dataset_t&&) = default;
 	dataset_t(dataset_t const&) = delete;
@@ -46,6 +53,12 @@ public:
 
 	std::map<dependency_id_t, object_id_t> create_dependency_map() const;
 	std::map<object_id_t, dependency_id_t> create_dependency_revmap() const;
+
+	// Matches objects and dependencies by their uri; to be called whenever objects or dependencies change
+	void index_uris();
+
+	// Identifies the objects and prior objects, which determine the partitions of a crossvalidation
+	uint64_t fingerprint() const;
 };
 
 namespace detail
@@ -64,38 +77,68 @@ namespace detail
 
 inline std::map<dependency_id_t, object_id_t> dataset_t::create_dependency_map() const
 {
-	std::map<uri_t, object_id_t> object_map;
-	objects.iterate([&](object_id_t id, uri_t const& u) {
-		object_map.emplace(std::make_pair(u, id));
-	});
-
 	std::map<dependency_id_t, object_id_t> dependency_map;
-	dependencies.iterate([&](dependency_id_t id, uri_t const& u) {
-		auto it = object_map.find(u);
-		if(it == object_map.end())
-			return;
-
-		dependency_map.emplace(std::make_pair(id, it->second));
+	dependency_objects.iterate([&](dependency_id_t id, boost::optional<object_id_t> const& o) {
+		if(o)
+			dependency_map.emplace_hint(dependency_map.end(), id, *o);
 	});
 	return dependency_map;
 }
 
 inline std::map<object_id_t, dependency_id_t> dataset_t::create_dependency_revmap() const
 {
-	std::map<uri_t, dependency_id_t> dependency_urimap;
-	dependencies.iterate([&](dependency_id_t id, uri_t const& u) {
-		dependency_urimap.emplace(std::make_pair(u, id));
+	std::map<object_id_t, dependency_id_t> dependency_revmap;
+	object_dependencies.iterate([&](object_id_t id, boost::optional<dependency_id_t> const& j) {
+		if(j)
+			dependency_revmap.emplace_hint(dependency_revmap.end(), id, *j);
 	});
+	return dependency_revmap;
+}
 
-	std::map<object_id_t, dependency_id_t> dependency_revmap;
-	objects.iterate([&](object_id_t id, uri_t const& u) {
-		auto it = dependency_urimap.find(u);
-		if(it == dependency_urimap.end())
+inline uint64_t dataset_t::fingerprint() const
+{
+	// FNV-1a, such that the fingerprint is the same across processes and platforms
+	uint64_t h = 14695981039346656037ull;
+	auto const add_f = [&](uint64_t x) {
+		for(size_t i = 0; i < sizeof(x); ++i)
+			h = (h ^ ((x >> (8 * i)) & 0xff)) * 1099511628211ull;
+	};
+
+	add_f(objects.size());
+	objects.iterate([&](object_id_t, uri_t const& u) {
+		for(char c : u)
+			h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+		add_f(u.size());
+	});
+
+	add_f(prior_objects.size());
+	for(object_id_t i : prior_objects)
+		add_f(i.unseal());
+
+	return h;
+}
+
+inline void dataset_t::index_uris()
+{
+	// The first object wins, should an uri occur twice
+	std::unordered_map<uri_t, object_id_t> uri_objects;
+	uri_objects.reserve(objects.size());
+	objects.iterate([&](object_id_t i, uri_t const& u) {
+		uri_objects.emplace(u, i);
+	});
+
+	dependency_objects = decltype(dependency_objects)(dependencies.size());
+	object_dependencies = decltype(object_dependencies)(objects.size());
+	dependencies.iterate([&](dependency_id_t j, uri_t const& u) {
+		auto it = uri_objects.find(u);
+		if(it == uri_objects.end())
 			return;
 
-		dependency_revmap.emplace(std::make_pair(id, it->second));
+		object_id_t const i = it->second;
+		dependency_objects[j] = i;
+		if(!object_dependencies[i])
+			object_dependencies[i] = j;
 	});
-	return dependency_revmap;
 }
 
 template<typename CONTAINER>
@@ -106,7 +149,11 @@ dataset_t::dataset_t(CONTAINER&& _objects, CONTAINER&& _features, CONTAINER&& _d
 	, feature_matrix(objects.size(), features.size())
 	, dependency_matrix(objects.size(), dependencies.size())
 	, prior_objects()
-{}
+	, dependency_objects()
+	, object_dependencies()
+{
+	index_uris();
+}
 
 inline dataset_t::dataset_t(
 		std::remove_const<decltype(objects)>::type&& _objects,
@@ -122,7 +169,11 @@ inline dataset_t::dataset_t(
 	, feature_matrix(std::move(_feature_matrix))
 	, dependency_matrix(std::move(_dependency_matrix))
 	, prior_objects(std::move(_prior_objects))
-{}
+	, dependency_objects()
+	, object_dependencies()
+{
+	index_uris();
+}
 
 }
 
@@ -43,7 +43,7 @@ public:
 		return result;
 	}
 
-	static dependant_obj_matrix_t create_obj_dependants(dataset_t const& d, std::map<dependency_id_t, object_id_t> const& dependency_map)
+	static dependant_obj_matrix_t create_obj_dependants(dataset_t const& d)
 	{
 		dependant_obj_matrix_t dependants_objs(d.objects.size(), d.objects.size());
 		d.dependency_matrix.citerate([&](dataset_t::dependency_matrix_t::const_row_proxy_t const& xs) {
@@ -52,23 +52,18 @@ public:
 					continue;
 				}
 
-				auto it = dependency_map.find(kvp.first);
-				if(it == dependency_map.end()) {
+				auto const& o = d.dependency_objects[kvp.first];
+				if(!o) {
 					continue;
 				}
 
 				// Dependency -> dependant
-				dependants_objs.set(std::make_pair(it->second, xs.row_i));
+				dependants_objs.set(std::make_pair(*o, xs.row_i));
 			}
 		});
 		return dependants_objs;
 	}
 
-	static dependant_obj_matrix_t create_obj_dependants(dataset_t const& d)
-	{
-		return create_obj_dependants(d, d.create_dependency_map());
-	}
-
 	template<typename F>
 	static void iterate_dependants(dependant_obj_matrix_t const& dependants, object_id_t i, F const& yield)
 	{
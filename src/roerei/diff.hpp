@@ -49,8 +49,9 @@ namespace roerei
 		 */
 		static void exec(std::string const& corpus_orig, std::string const& corpus_new)
 		{
+			auto c_new_future = storage::read_dataset_async(corpus_new);
 			auto c_orig = storage::read_dataset(corpus_orig);
-			auto c_new = storage::read_dataset(corpus_new);
+			auto c_new = c_new_future.get();
 			
 			std::string prefix = "/tmp/diff-";
 			prefix += boost::filesystem::unique_path().native();
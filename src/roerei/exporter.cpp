@@ -490,9 +490,22 @@ namespace roerei
       std::ofstream os(output_path+"/counts.tex");
       latex_tabular t(os);
 
-			auto process_f = [&](std::initializer_list<std::string>&& list) {
-				std::vector<std::string> corpus(list);
-				dataset_t d(storage::read_dataset(corpus[0]));
+			// Name, label, commit and date; the datasets are read ahead of the rows
+			std::vector<std::vector<std::string>> const rows({
+				{"Coq.frequency", "coq", "b705cf0", "april 2015"},
+				{"ch2o.frequency", "formalin", "64d98fa", "november 2015"},
+				{"MathClasses.frequency", "mathclasses", "751e63b", "june 2016"},
+				{"CoRN.frequency", "corn", "4860de7", "september 2009"},
+				{"mathcomp.frequency", "mathcomp", "9e81c8f", "december 2015"}
+			});
+
+			std::vector<std::string> corpii;
+			for(auto const& corpus : rows)
+				corpii.emplace_back(corpus[0]);
+
+			size_t i = 0;
+			storage::iterate_datasets(corpii, [&](std::string const&, dataset_t&& d) {
+				auto const& corpus = rows[i++];
 				t.write_row({
 							std::string("\\") + corpus[1],
 							corpus[2],
@@ -501,13 +514,7 @@ namespace roerei
 							round_print(d.features.size(), 0),
 							round_print(d.dependencies.size(), 0),
 				});
-			};
-
-      process_f({"Coq.frequency", "coq", "b705cf0", "april 2015"});
-      process_f({"ch2o.frequency", "formalin", "64d98fa", "november 2015"});
-			process_f({"MathClasses.frequency", "mathclasses", "751e63b", "june 2016"});
-			process_f({"CoRN.frequency", "corn", "4860de7", "september 2009"});
-      process_f({"mathcomp.frequency", "mathcomp", "9e81c8f", "december 2015"});
+			});
 	}
 	
 	void export_relative_kaliszyk(std::string const& source_path, std::string const& output_path)
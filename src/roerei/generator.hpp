@@ -7,8 +7,11 @@
 
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <algorithm>
 #include <set>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 namespace roerei
 {
@@ -65,6 +68,33 @@ private:
 		remove_irrelevant(str);
 	}
 
+	// Yields the feature and dependency entries of an object; the uris of s should already be mapped
+	template<typename FEATURE_MAP, typename DEPENDENCY_MAP, typename F, typename FEATURE_F, typename DEPENDENCY_F>
+	static void fill_row(summary_t const& s, FEATURE_MAP const& feature_map, DEPENDENCY_MAP const& dependency_map, F const& read_value, FEATURE_F const& feature_f, DEPENDENCY_F const& dependency_f)
+	{
+		for(auto const& t : s.type_uris)
+		{
+			if(blacklisted(t.uri))
+				continue;
+
+			feature_id_t col = feature_map.at(t.uri);
+			feature_f(col, read_value(t));
+		}
+
+		if(s.body_uris)
+			for(auto&& b : *s.body_uris)
+			{
+				if(blacklisted(b.uri))
+					continue;
+
+				auto it_col = dependency_map.find(b.uri);
+				if(it_col == dependency_map.end())
+					continue;
+				dependency_id_t col = it_col->second;
+				dependency_f(col, read_value(b));
+			}
+	}
+
 	struct phase1
 	{
 		std::set<uri_t> objects, prior_objects, term_uris, type_uris;
@@ -158,12 +188,16 @@ private:
 		std::map<uri_t, object_id_t> objects_map;
 		std::map<uri_t, feature_id_t> type_uris_map;
 		std::map<uri_t, dependency_id_t> dependency_map;
+		dataset_t::feature_matrix_t::builder_t feature_builder;
+		dataset_t::dependency_matrix_t::builder_t dependency_builder;
 
 		phase3(phase2&& rhs)
 			: d(std::move(rhs.objects), std::move(rhs.type_uris), std::move(rhs.dependencies))
 			, objects_map(create_map(d.objects))
 			, type_uris_map(create_map(d.features))
 			, dependency_map(create_map(d.dependencies))
+			, feature_builder(d.objects.size(), d.features.size())
+			, dependency_builder(d.objects.size(), d.dependencies.size())
 		{
 			for (uri_t po : rhs.prior_objects) {
 				d.prior_objects.emplace(objects_map.at(po));
@@ -179,32 +213,20 @@ private:
 			auto it = objects_map.find(s.uri);
 			if(it == objects_map.end())
 				return; // Ignore
-			object_id_t row = it->second;
-
-			auto fv(d.feature_matrix[row]);
-			auto dv(d.dependency_matrix[row]);
-
-			for(auto const& t : s.type_uris)
-			{
-				if(blacklisted(t.uri))
-					continue;
 
-				feature_id_t col = type_uris_map.at(t.uri);
-				fv[col] = read_value(t);
-			}
-
-			if(s.body_uris)
-				for(auto&& b : *s.body_uris)
-				{
-					if(blacklisted(b.uri))
-						continue;
+			object_id_t const row = it->second;
+			fill_row(s, type_uris_map, dependency_map, read_value, [&](feature_id_t col, size_t v) {
+				feature_builder.add(row, col, v);
+			}, [&](dependency_id_t col, size_t v) {
+				dependency_builder.add(row, col, v);
+			});
+		}
 
-					auto it_col = dependency_map.find(b.uri);
-					if(it_col == dependency_map.end())
-						continue;
-					dependency_id_t col = it_col->second;
-					dv[col] = read_value(b);
-				}
+		dataset_t finalize()
+		{
+			d.feature_matrix = feature_builder.finalize();
+			d.dependency_matrix = dependency_builder.finalize();
+			return std::move(d);
 		}
 
 	};
@@ -275,11 +297,128 @@ public:
 
 		std::map<std::string, dataset_t> result;
 		for(auto&& kvp : p3)
-			result.emplace(kvp.first, std::move(kvp.second.d));
+			result.emplace(kvp.first, kvp.second.finalize());
 
 		return result;
 	}
 
+	/* Appends the objects of new summaries to an existing dataset, in time proportional to the summaries
+	 * instead of regenerating the dataset from the whole repository.
+	 *
+	 * New features, dependencies and objects get the next ids, in order of their uri; existing ids, rows and
+	 * prior objects are kept as is, thus summaries of objects which already are in the dataset are ignored.
+	 * As in construct, objects without any dependency are left out. Unlike construct, a dependency remains
+	 * a dependency if it becomes a type. Returns the id of the first appended object.
+	 */
+	static object_id_t append(dataset_t& d, std::vector<summary_t>&& summaries, std::map<uri_t, uri_t> const& mapping, variant_e variant)
+	{
+		object_id_t const first_object(d.objects.size());
+
+		std::unordered_map<uri_t, object_id_t> objects_map;
+		std::unordered_map<uri_t, feature_id_t> feature_map;
+		std::unordered_map<uri_t, dependency_id_t> dependency_map;
+		d.objects.iterate([&](object_id_t id, uri_t const& u) { objects_map.emplace(u, id); });
+		d.features.iterate([&](feature_id_t id, uri_t const& u) { feature_map.emplace(u, id); });
+		d.dependencies.iterate([&](dependency_id_t id, uri_t const& u) { dependency_map.emplace(u, id); });
+
+		// List the new objects, terms and types, as in phase1
+		std::map<uri_t, summary_t> candidates;
+		std::set<uri_t> term_uris, type_uris;
+		for(auto&& s : summaries)
+		{
+			if(s.type_uris.empty())
+				continue;
+			map_summary_f(s, mapping);
+
+			for(auto const& t : s.type_uris)
+				if(!blacklisted(t.uri) && feature_map.find(t.uri) == feature_map.end())
+					type_uris.emplace(t.uri);
+
+			if(!s.body_uris || objects_map.find(s.uri) != objects_map.end())
+				continue;
+
+			bool added_something = false;
+			for(auto const& b : *s.body_uris)
+			{
+				if(blacklisted(b.uri))
+					continue;
+
+				term_uris.emplace(b.uri);
+				added_something = true;
+			}
+
+			if(added_something)
+				candidates.emplace(s.uri, std::move(s));
+		}
+
+		for(auto&& u : type_uris)
+		{
+			feature_map.emplace(u, feature_id_t(d.features.size()));
+			d.features.emplace_back(std::move(u));
+		}
+
+		// Determine the new dependencies, as in phase2
+		for(auto&& u : term_uris)
+		{
+			if(feature_map.find(u) != feature_map.end() || dependency_map.find(u) != dependency_map.end())
+				continue;
+
+			dependency_map.emplace(u, dependency_id_t(d.dependencies.size()));
+			d.dependencies.emplace_back(std::move(u));
+		}
+
+		// Remove objects without any dependency
+		for(auto it = candidates.begin(); it != candidates.end();)
+		{
+			auto const& body = *it->second.body_uris;
+			bool const has_dependency = std::any_of(body.begin(), body.end(), [&](summary_t::occurance_t const& b) {
+				return !blacklisted(b.uri) && dependency_map.find(b.uri) != dependency_map.end();
+			});
+
+			if(has_dependency)
+				++it;
+			else
+				it = candidates.erase(it);
+		}
+
+		for(auto const& kvp : candidates)
+			d.objects.emplace_back(kvp.first);
+
+		// Fill the new rows, as in phase3
+		d.feature_matrix.resize(d.objects.size(), d.features.size());
+		d.dependency_matrix.resize(d.objects.size(), d.dependencies.size());
+
+		auto fill_rows = [&](auto const& read_value) {
+			size_t i = first_object.unseal();
+			for(auto const& kvp : candidates)
+			{
+				auto fv(d.feature_matrix[object_id_t(i)]);
+				auto dv(d.dependency_matrix[object_id_t(i)]);
+				fill_row(kvp.second, feature_map, dependency_map, read_value, [&](feature_id_t col, size_t v) {
+					fv[col] = v;
+				}, [&](dependency_id_t col, size_t v) {
+					dv[col] = v;
+				});
+				++i;
+			}
+		};
+
+		switch(variant) {
+		case variant_e::frequency:
+			fill_rows([](summary_t::occurance_t const& occ) { return occ.freq; });
+			break;
+		case variant_e::depth:
+			fill_rows([](summary_t::occurance_t const& occ) { return occ.depth; });
+			break;
+		case variant_e::flat:
+			fill_rows([](summary_t::occurance_t const& occ) { return occ.freq == 1 ? 1 : 0; });
+			break;
+		}
+
+		d.index_uris();
+		return first_object;
+	}
+
 	static std::map<std::string, dataset_t> construct_from_repo(variant_e variant)
 	{
 		return construct(
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <roerei/generic/row_mask.hpp>
+
+#include <boost/optional.hpp>
+
 #include <vector>
 
 namespace roerei
 {
 
+// View of the rows of a matrix which are not listed; the listed rows are marked in the mask for as long as the view exists
 template<typename MATRIX>
 class bl_sparse_matrix_t
 {
@@ -14,14 +19,34 @@ public:
 private:
 	MATRIX const& data;
 	std::vector<row_key_t> const& bl;
+	row_mask_t<row_key_t>* mask; // Null when moved from
 
 public:
 	typedef typename MATRIX::const_row_proxy_t const_row_proxy_t;
 
-	bl_sparse_matrix_t(MATRIX const& _data, std::vector<row_key_t> const& _bl)
+	bl_sparse_matrix_t(MATRIX const& _data, std::vector<row_key_t> const& _bl, row_mask_t<row_key_t>& _mask)
 		: data(_data)
 		, bl(_bl)
-	{}
+		, mask(&_mask)
+	{
+		mask->set(bl);
+	}
+
+	bl_sparse_matrix_t(bl_sparse_matrix_t&& rhs)
+		: data(rhs.data)
+		, bl(rhs.bl)
+		, mask(rhs.mask)
+	{
+		rhs.mask = nullptr;
+	}
+
+	bl_sparse_matrix_t(bl_sparse_matrix_t const&) = delete;
+
+	~bl_sparse_matrix_t()
+	{
+		if(mask)
+			mask->reset(bl);
+	}
 
 	size_t size_m() const
 	{
@@ -35,20 +60,31 @@ public:
 
 	const_row_proxy_t operator[](row_key_t const i) const
 	{
-		if(std::binary_search(bl.begin(), bl.end(), i))
+		if((*mask)[i])
 			throw std::out_of_range("Element blacklisted");
 
 		return data[i];
 	}
 
+	bool contains(row_key_t const i) const
+	{
+		return !(*mask)[i] && data.contains(i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(row_key_t const i) const
+	{
+		if((*mask)[i])
+			return boost::none;
+
+		return data.try_row(i);
+	}
+
 	template<typename F>
 	void citerate(F const& f) const
 	{
-		auto it = bl.begin();
-		auto const it_end = bl.end();
+		row_mask_t<row_key_t> const& m = *mask;
 		data.citerate([&](typename MATRIX::const_row_proxy_t const& row) {
-			it = std::lower_bound(it, it_end, row.row_i);
-			if(it != it_end && *it == row.row_i)
+			if(m[row.row_i])
 				return;
 
 			f(row);
@@ -8,8 +8,10 @@
 
 #include <boost/optional.hpp>
 
+#include <algorithm>
 #include <vector>
 #include <map>
+#include <limits>
 
 #define invalid_value (std::numeric_limits<size_t>::max())
 
@@ -169,6 +171,27 @@ public:
 		return const_row_proxy_t(*this, rows[i], i);
 	}
 
+	bool contains(M i) const
+	{
+		return i.unseal() < m && !rows[i].is_invalid();
+	}
+
+	boost::optional<row_proxy_t> try_row(M i)
+	{
+		if(!contains(i))
+			return boost::none;
+
+		return row_proxy_t(*this, rows[i], i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(M i) const
+	{
+		if(!contains(i))
+			return boost::none;
+
+		return const_row_proxy_t(*this, rows[i], i);
+	}
+
 	size_t size_m() const
 	{
 		return m;
@@ -193,7 +216,14 @@ public:
 	template<typename F>
 	void citerate(F const& f) const
 	{
-		for(size_t i = 0; i < m; ++i)
+		citerate(M(0), M(m), f);
+	}
+
+	// Iterates over the present rows i with begin <= i < end, in order
+	template<typename F>
+	void citerate(M const begin, M const end, F const& f) const
+	{
+		for(size_t i = begin.unseal(), i_end = std::min(end.unseal(), m); i < i_end; ++i)
 		{
 			M im(i);
 			if(!rows[im].is_invalid())
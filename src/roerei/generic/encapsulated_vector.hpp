@@ -15,6 +15,8 @@ public:
 	encapsulated_vector() = default;
 	encapsulated_vector(encapsulated_vector const&) = default;
 	encapsulated_vector(encapsulated_vector&&) = default;
+	encapsulated_vector& operator=(encapsulated_vector const&) = default;
+	encapsulated_vector& operator=(encapsulated_vector&&) = default;
 	encapsulated_vector(size_t n)
 		: buf(n)
 	{}
@@ -33,6 +35,11 @@ public:
 		buf.reserve(n);
 	}
 
+	void resize(size_t n)
+	{
+		buf.resize(n);
+	}
+
 	size_t size() const
 	{
 		return buf.size();
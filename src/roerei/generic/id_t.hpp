@@ -1,19 +1,36 @@
 #pragma once
 
+#include <roerei/serialization/binary.hpp>
+#include <roerei/serialization/deserialize_common.hpp>
+
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <string>
 
 namespace roerei
 {
 
-template<typename T>
+/* Strongly typed index. The index is stored in STORAGE, which by default is 32 bits wide, such that
+ * sparse entries of an id and a small value are packed in 8 bytes instead of 16.
+ */
+template<typename T, typename STORAGE = uint32_t>
 class id_t
 {
-	size_t id;
+public:
+	typedef STORAGE storage_t;
+
+private:
+	STORAGE id;
 
 protected:
 	id_t(size_t _id)
-		: id(_id)
-	{}
+		: id(static_cast<STORAGE>(_id))
+	{
+		assert(_id <= std::numeric_limits<STORAGE>::max());
+	}
 
 public:
 	size_t unseal() const
@@ -75,6 +92,21 @@ struct serialize_value<object_id_t, S>
 	}
 };
 
+// Sets of ids are stored as a single binary blob (see binary)
+template<typename S>
+struct serialize_value<std::set<object_id_t>, S>
+{
+	static inline void exec(S& s, std::string const& name, std::set<object_id_t> const& xs)
+	{
+		std::string buf;
+		buf.reserve(xs.size() * sizeof(uint32_t));
+		for(object_id_t x : xs)
+			binary::append<uint32_t>(buf, x.unseal());
+
+		s.write_bin(name, buf);
+	}
+};
+
 template<typename T, typename D>
 struct deserialize_value;
 
@@ -89,6 +121,30 @@ struct deserialize_value<object_id_t, D>
 	}
 };
 
+// Earlier files store the set as an array of ids
+template<typename D>
+struct deserialize_value<std::set<object_id_t>, D>
+{
+	static inline std::set<object_id_t> exec(D& s, const std::string& name)
+	{
+		std::set<object_id_t> xs;
+		try
+		{
+			auto const buf = s.read_bin(name);
+			for(std::size_t i = 0, n = binary::count<uint32_t>(buf.second); i < n; ++i)
+				xs.emplace_hint(xs.end(), binary::read<uint32_t>(buf.first + i * sizeof(uint32_t)));
+		} catch(type_error const&)
+		{
+			const std::string element_name = name + "_e";
+			const std::size_t n = s.read_array(name);
+			for(std::size_t i = 0; i < n; ++i)
+				xs.emplace(deserialize_value<object_id_t, D>::exec(s, element_name));
+		}
+
+		return xs;
+	}
+};
+
 }
 
 }
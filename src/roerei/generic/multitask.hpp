@@ -1,16 +1,41 @@
 #pragma once
 
+#include <roerei/util/events.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <sstream>
+#include <iostream>
 
 namespace roerei
 {
 	class multitask
 	{
+		// Identity of the jobset of which the current thread runs a task
+		static size_t& current_jobset()
+		{
+			static thread_local size_t ident = 0;
+			return ident;
+		}
+
+		// The multitask of which the current thread is a worker
+		static multitask*& current()
+		{
+			static thread_local multitask* m = nullptr;
+			return m;
+		}
+
 		class jobset_t
 		{
-			static size_t jobset_count;
+			friend class multitask;
+
+			static std::atomic<size_t> jobset_count;
 
 			std::vector<std::packaged_task<void()>> tasks;
 			std::packaged_task<void()> continuation;
@@ -58,6 +83,10 @@ namespace roerei
 					std::cerr << ss.str() << std::endl;
 				}
 
+				events::emit(events::event_t("task_start")("jobset", jobset_ident)("task", i)("tasks", tasks.size()));
+				auto const start = std::chrono::steady_clock::now();
+
+				current_jobset() = jobset_ident;
 				t(); // Execute packaged task
 
 				{
@@ -66,6 +95,10 @@ namespace roerei
 					std::cerr << ss.str() << std::endl;
 				}
 
+				events::emit(events::event_t("task_end")("jobset", jobset_ident)("task", i)("tasks", tasks.size())
+					("duration", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+					("peak_rss_kb", events::peak_rss_kb()));
+
 				future.get(); // Yield exception
 
 				{
@@ -80,6 +113,7 @@ namespace roerei
 					std::cerr << ss.str() << std::endl;
 				}
 
+				current_jobset() = jobset_ident;
 				continuation(); // Execute continuation
 
 				{
@@ -88,34 +122,78 @@ namespace roerei
 					std::cerr << ss.str() << std::endl;
 				}
 
+				events::emit(events::event_t("jobset_end")("jobset", jobset_ident)("tasks", tasks.size()));
+
 				return false;
 			}
 		};
 
 		std::vector<jobset_t> jobsets;
+		std::atomic<size_t> idle; // Workers without any task left to start, which are not borrowed
 
 		void handlet()
 		{
+			multitask* const parent = current();
+			current() = this;
+
 			for(auto& jobset : jobsets)
 			{
 				while(jobset.run())
 				{}
 			}
+
+			current() = parent;
+			idle++;
 		}
 
 	public:
 		multitask()
 			: jobsets()
+			, idle(0)
 		{}
 
-		void add(jobset_t&& _jobset)
+		/* Borrows at most n of the idle workers of the multitask which runs the current thread, for the
+		 * nested parallelism of a task; outside of a multitask all n are granted. Give them back when done.
+		 */
+		static size_t borrow(size_t n)
 		{
+			multitask* const m = current();
+			if(!m)
+				return n;
+
+			size_t available = m->idle.load();
+			size_t granted;
+			do
+			{
+				granted = std::min(n, available);
+			} while(!m->idle.compare_exchange_weak(available, available - granted));
+
+			return granted;
+		}
+
+		static void give_back(size_t n)
+		{
+			if(multitask* const m = current())
+				m->idle += n;
+		}
+
+		// Returns the identity of the jobset, also used in its events
+		size_t add(jobset_t&& _jobset)
+		{
+			size_t const ident = _jobset.jobset_ident;
 			jobsets.emplace_back(std::move(_jobset));
+			return ident;
+		}
+
+		static size_t jobset()
+		{
+			return current_jobset();
 		}
 
 		void run(size_t n = 1, bool blocking = true)
 		{
 			std::cerr << "Starting " << jobsets.size() << " jobsets" << std::endl;
+			events::emit(events::event_t("run")("jobsets", jobsets.size())("threads", n));
 
 			std::vector<std::thread> threads;
 			threads.reserve(n);
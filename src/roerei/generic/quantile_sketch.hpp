@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+namespace roerei
+{
+
+/* Streaming estimation of quantiles of non-negative values, with logarithmically sized buckets.
+ * Every estimate is within a relative error alpha of a value of the exact quantile.
+ * Sketches with the same alpha can be merged without any loss.
+ */
+class quantile_sketch_t
+{
+public:
+	static constexpr double default_alpha = 0.01;
+
+private:
+	double alpha, gamma, log_gamma;
+
+	size_t zero_count, count;
+	std::map<int, size_t> buckets; // ceil(log_gamma(x)) -> count
+
+	// Values below this are counted as zero
+	static constexpr double min_value = 1e-9;
+
+	int bucket(double x) const
+	{
+		return static_cast<int>(std::ceil(std::log(x) / log_gamma));
+	}
+
+	double value(int k) const
+	{
+		return 2.0 * std::pow(gamma, k) / (gamma + 1.0);
+	}
+
+public:
+	quantile_sketch_t(double _alpha = default_alpha)
+		: alpha(_alpha)
+		, gamma((1.0 + alpha) / (1.0 - alpha))
+		, log_gamma(std::log(gamma))
+		, zero_count(0)
+		, count(0)
+		, buckets()
+	{}
+
+	void add(double x, size_t n = 1)
+	{
+		if(n == 0)
+			return;
+
+		if(x < min_value)
+			zero_count += n;
+		else
+			buckets[bucket(x)] += n;
+
+		count += n;
+	}
+
+	quantile_sketch_t& operator+=(quantile_sketch_t const& rhs)
+	{
+		if(alpha != rhs.alpha)
+			throw std::runtime_error("Cannot merge sketches of different accuracy");
+
+		zero_count += rhs.zero_count;
+		count += rhs.count;
+		for(auto const& kvp : rhs.buckets)
+			buckets[kvp.first] += kvp.second;
+
+		return *this;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	// q in [0, 1]; NaN when empty
+	double quantile(double q) const
+	{
+		if(count == 0)
+			return NAN;
+
+		size_t const rank = static_cast<size_t>(q * static_cast<double>(count - 1));
+		if(rank < zero_count)
+			return 0.0;
+
+		size_t seen = zero_count;
+		for(auto const& kvp : buckets)
+		{
+			seen += kvp.second;
+			if(rank < seen)
+				return value(kvp.first);
+		}
+
+		return value(buckets.rbegin()->first);
+	}
+};
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace roerei
+{
+
+/* Dense membership of rows, for views which list part of the rows of a large matrix.
+ * Setting and resetting the rows of a list takes O(|list|), such that a single mask is reused for
+ * all test rows, and membership is a single lookup instead of a binary search in the list.
+ */
+template<typename M>
+class row_mask_t
+{
+private:
+	std::vector<uint8_t> bits;
+
+public:
+	row_mask_t()
+		: bits()
+	{}
+
+	row_mask_t(row_mask_t const&) = delete;
+
+	// Mask of the current thread, with room for at least m rows; a view holds it until destroyed,
+	// thus only a single view per thread may use it at a time
+	static row_mask_t& local(size_t m)
+	{
+		thread_local row_mask_t mask;
+		if(mask.bits.size() < m)
+			mask.bits.resize(m, 0);
+
+		return mask;
+	}
+
+	bool operator[](M const i) const
+	{
+		return i.unseal() < bits.size() && bits[i.unseal()];
+	}
+
+	template<typename LIST>
+	void set(LIST const& xs)
+	{
+		for(M const x : xs)
+		{
+			if(x.unseal() >= bits.size())
+				bits.resize(x.unseal() + 1, 0);
+
+			bits[x.unseal()] = 1;
+		}
+	}
+
+	template<typename LIST>
+	void reset(LIST const& xs)
+	{
+		for(M const x : xs)
+			if(x.unseal() < bits.size())
+				bits[x.unseal()] = 0;
+	}
+};
+
+}
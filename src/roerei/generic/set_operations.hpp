@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <iterator>
 
 namespace roerei {
@@ -42,27 +43,25 @@ void set_compute_binary_intersect(
 	auto a_it = a_begin;
 	auto b_it = b_begin;
 
-	auto bi = b_f(*b_it);
-
 	while(b_it != b_end)
 	{
-		a_it = std::lower_bound(a_it, a_end, *b_it, [&](auto&& ap, auto&& bp) {
-			return a_f(ap) < b_f(bp);
+		auto bi = b_f(*b_it);
+		a_it = std::lower_bound(a_it, a_end, bi, [&](auto&& ap, auto&& bk) {
+			return a_f(ap) < bk;
 		}); // Performs binary search
-		auto ai = a_f(*a_it);
 
-		if(b_it == b_end)
+		if(a_it == a_end)
 			break;
 
+		auto ai = a_f(*a_it);
 		if(ai == bi)
 			f(*a_it, *b_it);
 
 		do
 		{
 			b_it++;
-			bi = b_f(*b_it);
 		}
-		while(b_it != b_end && bi < ai);
+		while(b_it != b_end && b_f(*b_it) < ai);
 	}
 }
 
@@ -44,6 +44,20 @@ public:
 		keys.erase(i);
 	}
 
+	bool contains(row_key_t const i) const
+	{
+		return keys.find(i) != keys.end() && data.contains(i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(row_key_t const i) const
+	{
+		if(keys.find(i) == keys.end())
+			return boost::none;
+
+		auto const& d = data;
+		return d.try_row(i);
+	}
+
 	size_t nonempty_size_m() const
 	{
 		return keys.size();
@@ -76,6 +90,15 @@ public:
 		}
 	}
 
+	// Iterates over the rows i with begin <= i < end, in order
+	template<typename F>
+	void citerate(row_key_t const begin, row_key_t const end, F const& f) const
+	{
+		auto const& d = data;
+		for(auto it = keys.lower_bound(begin), it_end = keys.lower_bound(end); it != it_end; ++it)
+			f(d[*it]);
+	}
+
 	template<typename F>
 	void iterate(F const& f) const
 	{
@@ -3,8 +3,14 @@
 #include <roerei/generic/common.hpp>
 #include <roerei/generic/encapsulated_vector.hpp>
 
+#include <roerei/serialization/binary.hpp>
+
+#include <boost/container/flat_map.hpp>
 #include <boost/optional.hpp>
 
+#include <algorithm>
+#include <limits>
+#include <string>
 #include <vector>
 #include <map>
 
@@ -18,7 +24,8 @@ public:
 	typedef M row_key_t;
 	typedef N column_key_t;
 
-	typedef std::map<N, T> row_t;
+	// Rows are sorted vectors; inserting is linear in the length of a row, thus build large matrices with builder_t
+	typedef boost::container::flat_map<N, T> row_t;
 
 	template<typename MATRIX, typename ITERATOR>
 	class row_proxy_base_t
@@ -51,14 +58,12 @@ public:
 		T const operator[](N j) const
 		{
 			assert(j < parent.n);
-			try
-			{
-				return parent.data[row_i].at(j);
-			}
-			catch(std::out_of_range)
-			{
+			auto const& row = parent.data[row_i];
+			auto const it = row.find(j);
+			if(it == row.end())
 				return 0;
-			}
+
+			return it->second;
 		}
 
 		iterator begin() const
@@ -86,12 +91,13 @@ public:
 	typedef row_proxy_base_t<sparse_matrix_t<M, N, T> const, typename row_t::const_iterator> const_row_proxy_t;
 
 private:
-	const size_t m, n;
+	size_t m, n;
 	encapsulated_vector<M, row_t> data;
 
 public:
 	sparse_matrix_t(sparse_matrix_t&&) = default;
 	sparse_matrix_t(sparse_matrix_t&) = delete;
+	sparse_matrix_t& operator=(sparse_matrix_t&&) = default;
 
 	sparse_matrix_t(size_t _m, size_t _n)
 		: m(_m)
@@ -111,6 +117,28 @@ public:
 		return const_row_proxy_t(*this, i);
 	}
 
+	// All rows up to m are present, even when empty
+	bool contains(M i) const
+	{
+		return i.unseal() < m;
+	}
+
+	boost::optional<row_proxy_t> try_row(M i)
+	{
+		if(!contains(i))
+			return boost::none;
+
+		return row_proxy_t(*this, i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(M i) const
+	{
+		if(!contains(i))
+			return boost::none;
+
+		return const_row_proxy_t(*this, i);
+	}
+
 	size_t size_m() const
 	{
 		return m;
@@ -121,6 +149,15 @@ public:
 		return n;
 	}
 
+	// Grows the matrix, keeping all existing entries
+	void resize(size_t _m, size_t _n)
+	{
+		assert(_m >= m && _n >= n);
+		m = _m;
+		n = _n;
+		data.resize(m);
+	}
+
 	template<typename F>
 	void iterate(F const& f)
 	{
@@ -128,10 +165,84 @@ public:
 			f(row_proxy_t(*this, M(i)));
 	}
 
+	// Replaces row i by the entries in [begin, end), which must be ordered by column without repetitions
+	template<typename ITERATOR>
+	void assign_sorted(M i, ITERATOR begin, ITERATOR end)
+	{
+		assert(i.unseal() < m);
+		data[i] = row_t(boost::container::ordered_unique_range, begin, end);
+	}
+
+	/* Collects the entries of a matrix in any order, and sorts every row once when finalized.
+	 * Of repeated entries of a row and column, the last one is kept.
+	 */
+	class builder_t
+	{
+	private:
+		size_t m, n;
+		encapsulated_vector<M, std::vector<std::pair<N, T>>> rows;
+
+	public:
+		builder_t(size_t _m, size_t _n)
+			: m(_m)
+			, n(_n)
+			, rows(m)
+		{}
+
+		void reserve(M i, size_t entries)
+		{
+			rows[i].reserve(entries);
+		}
+
+		void add(M i, N j, T v)
+		{
+			assert(i.unseal() < m && j.unseal() < n);
+			rows[i].emplace_back(j, v);
+		}
+
+		sparse_matrix_t finalize()
+		{
+			sparse_matrix_t result(m, n);
+			for(size_t i = 0; i < m; ++i)
+			{
+				auto& xs = rows[M(i)];
+				auto comp = [](std::pair<N, T> const& x, std::pair<N, T> const& y) {
+					return x.first < y.first;
+				};
+
+				if(!std::is_sorted(xs.begin(), xs.end(), comp))
+					std::stable_sort(xs.begin(), xs.end(), comp);
+
+				// Keep the last of repeated columns
+				auto it = xs.begin();
+				for(auto jt = xs.begin(); jt != xs.end(); ++jt)
+				{
+					if(it != xs.begin() && (it - 1)->first == jt->first)
+						*(it - 1) = *jt;
+					else
+						*it++ = *jt;
+				}
+				xs.erase(it, xs.end());
+
+				result.assign_sorted(M(i), xs.begin(), xs.end());
+				std::vector<std::pair<N, T>>().swap(xs);
+			}
+
+			return result;
+		}
+	};
+
 	template<typename F>
 	void citerate(F const& f) const
 	{
-		for(size_t i = 0; i < m; ++i)
+		citerate(M(0), M(m), f);
+	}
+
+	// Iterates over the rows i with begin <= i < end, in order
+	template<typename F>
+	void citerate(M const begin, M const end, F const& f) const
+	{
+		for(size_t i = begin.unseal(), i_end = std::min(end.unseal(), m); i < i_end; ++i)
 			f(const_row_proxy_t(*this, M(i)));
 	}
 
@@ -145,6 +256,10 @@ public:
 namespace detail
 {
 
+/* Matrices are stored as a map of m, n and three binary blobs (see binary):
+ * the number of entries of every row, and the columns and values of all entries in order.
+ * Earlier files, which store every entry as a separate [j, v] array under "data", can still be read.
+ */
 template<typename T, typename S>
 struct serialize_value;
 
@@ -153,21 +268,26 @@ struct serialize_value<sparse_matrix_t<M, N, T>, S>
 {
 	static inline void exec(S& s, std::string const& name, sparse_matrix_t<M, N, T> const& m)
 	{
-		s.write_object(name, 3);
-		s.write("m", m.size_m());
-		s.write("n", m.size_n());
-		s.write_array("data", m.size_m());
+		if(m.size_n() > std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error("Matrix too wide to serialize");
 
+		std::string sizes, columns, values;
+		sizes.reserve(m.size_m() * sizeof(uint32_t));
 		m.citerate([&](typename sparse_matrix_t<M, N, T>::const_row_proxy_t const& row) {
-			s.write_array("row", row.nonempty_size());
-
-                        for(auto kvp : row)
+			binary::append<uint32_t>(sizes, row.nonempty_size());
+			for(auto const& kvp : row)
 			{
-				s.write_array("kvp", 2);
-				s.write("j", kvp.first.unseal());
-				s.write("v", kvp.second);
+				binary::append<uint32_t>(columns, kvp.first.unseal());
+				binary::append<T>(values, kvp.second);
 			}
 		});
+
+		s.write_object(name, 5);
+		s.write("m", m.size_m());
+		s.write("n", m.size_n());
+		s.write_bin("sizes", sizes);
+		s.write_bin("columns", columns);
+		s.write_bin("values", values);
 	}
 };
 
@@ -179,22 +299,66 @@ struct deserialize_value<sparse_matrix_t<M, N, T>, D>
 {
 	static inline sparse_matrix_t<M, N, T> exec(D& s, const std::string& name)
 	{
-		if(3 != s.read_object(name))
+		std::size_t const fields = s.read_object(name);
+		if(fields != 3 && fields != 5)
 			throw std::runtime_error("Inconsistency");
 
 		std::size_t m, n;
 		s.read("m", m);
 		s.read("n", n);
+
+		if(fields == 3)
+			return read_entries(s, m, n);
+
+		auto const sizes = s.read_bin("sizes");
+		auto const columns = s.read_bin("columns");
+		auto const values = s.read_bin("values");
+
+		std::size_t const nonempty = binary::count<uint32_t>(columns.second);
+		if(binary::count<uint32_t>(sizes.second) != m || binary::count<T>(values.second) != nonempty)
+			throw std::runtime_error("Inconsistency");
+
+		sparse_matrix_t<M, N, T> result(m, n);
+		std::vector<std::pair<N, T>> row;
+		std::size_t t = 0;
+		for(std::size_t i = 0; i < m; ++i)
+		{
+			std::size_t const sparse_els = binary::read<uint32_t>(sizes.first + i * sizeof(uint32_t));
+			if(sparse_els > nonempty - t)
+				throw std::runtime_error("Inconsistency");
+
+			row.clear();
+			for(std::size_t t_end = t + sparse_els; t < t_end; ++t)
+			{
+				std::size_t const j = binary::read<uint32_t>(columns.first + t * sizeof(uint32_t));
+				if(j >= n || (!row.empty() && j <= row.back().first.unseal()))
+					throw std::runtime_error("Inconsistency");
+
+				row.emplace_back(N(j), binary::read<T>(values.first + t * sizeof(T)));
+			}
+
+			result.assign_sorted(M(i), row.begin(), row.end());
+		}
+
+		if(t != nonempty)
+			throw std::runtime_error("Inconsistency");
+
+		return result;
+	}
+
+private:
+	static inline sparse_matrix_t<M, N, T> read_entries(D& s, std::size_t m, std::size_t n)
+	{
 		std::size_t m_real = s.read_array("data");
 
 		if(m != m_real)
 			throw std::runtime_error("Inconsistency");
 
-		sparse_matrix_t<M, N, T> result(m, n);
+		typename sparse_matrix_t<M, N, T>::builder_t result(m, n);
 		for(std::size_t i = 0; i < m; ++i)
 		{
-			auto row = result[i];
-			std::size_t sparse_els = s.read_array("row"); // TODO reserve row_t
+			std::size_t sparse_els = s.read_array("row");
+			result.reserve(i, sparse_els);
 
 			for(std::size_t t = 0; t < sparse_els; ++t)
 			{
@@ -205,11 +369,14 @@ struct deserialize_value<sparse_matrix_t<M, N, T>, D>
 				s.read("j", j);
 				s.read("v", v);
 
-				row[j] = v;
+				if(j >= n)
+					throw std::runtime_error("Inconsistency");
+
+				result.add(i, j, v);
 			}
 		}
 
-		return result;
+		return result.finalize();
 	}
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <boost/optional.hpp>
+
 namespace roerei
 {
 
@@ -39,15 +41,24 @@ public:
 		return data[i];
 	}
 
+	bool contains(row_key_t const i) const
+	{
+		return i < end && data.contains(i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(row_key_t const i) const
+	{
+		if(i >= end)
+			return boost::none;
+
+		return data.try_row(i);
+	}
+
+	// Rows are iterated in order, thus the iteration stops at the split instead of filtering all rows
 	template<typename F>
 	void citerate(F const& f) const
 	{
-		data.citerate([&](typename MATRIX::const_row_proxy_t const& row) {
-			if(row.row_i >= end)
-				return;
-
-			f(row);
-		});
+		data.citerate(row_key_t(0), end, f);
 	}
 };
 
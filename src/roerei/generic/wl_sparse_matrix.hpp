@@ -1,10 +1,18 @@
 #pragma once
 
+#include <roerei/generic/row_mask.hpp>
+
+#include <boost/optional.hpp>
+
 #include <vector>
 
 namespace roerei
 {
 
+/* View of the listed rows of a matrix.
+ * The listed rows are marked in the mask on the first lookup, which iteration does not need, and
+ * unmarked when the view is destroyed.
+ */
 template<typename MATRIX, typename WL = std::vector<typename MATRIX::row_key_t>>
 class wl_sparse_matrix_t
 {
@@ -14,15 +22,47 @@ public:
 private:
 	MATRIX const& data;
 	WL const& wl;
+	row_mask_t<row_key_t>* mask; // Null when moved from
+	mutable bool marked;
+
+	row_mask_t<row_key_t> const& listed() const
+	{
+		if(!marked)
+		{
+			mask->set(wl);
+			marked = true;
+		}
+
+		return *mask;
+	}
 
 public:
 	typedef typename MATRIX::const_row_proxy_t const_row_proxy_t;
 
-	wl_sparse_matrix_t(MATRIX const& _data, WL const& _wl)
+	wl_sparse_matrix_t(MATRIX const& _data, WL const& _wl, row_mask_t<row_key_t>& _mask)
 		: data(_data)
 		, wl(_wl)
+		, mask(&_mask)
+		, marked(false)
 	{}
 
+	wl_sparse_matrix_t(wl_sparse_matrix_t&& rhs)
+		: data(rhs.data)
+		, wl(rhs.wl)
+		, mask(rhs.mask)
+		, marked(rhs.marked)
+	{
+		rhs.mask = nullptr;
+	}
+
+	wl_sparse_matrix_t(wl_sparse_matrix_t const&) = delete;
+
+	~wl_sparse_matrix_t()
+	{
+		if(mask && marked)
+			mask->reset(wl);
+	}
+
 	size_t size_m() const
 	{
 		return data.size_m();
@@ -35,21 +75,34 @@ public:
 
 	const_row_proxy_t operator[](row_key_t const i) const
 	{
-		if(!std::binary_search(wl.begin(), wl.end(), i))
+		if(!listed()[i])
 			throw std::out_of_range("Element not listed");
 
 		return data[i];
 	}
 
+	bool contains(row_key_t const i) const
+	{
+		return listed()[i] && data.contains(i);
+	}
+
+	boost::optional<const_row_proxy_t> try_row(row_key_t const i) const
+	{
+		if(!listed()[i])
+			return boost::none;
+
+		return data.try_row(i);
+	}
+
+	// Listed rows which are not present in the matrix are skipped
 	template<typename F>
 	void citerate(F const& f) const
 	{
 		for(auto i : wl)
 		{
-			try
-			{
-				f(data[i]);
-			} catch(std::out_of_range) {}
+			auto const row = data.try_row(i);
+			if(row)
+				f(*row);
 		}
 	}
 };
@@ -40,8 +40,6 @@ public:
 		auto const d(posetcons_canonical::consistentize(d_orig));
 
 		//posetcons_canonical pc(d);
-		auto depmap(d.create_dependency_map());
-
 		std::cout << "d size " << d.dependencies.size() << std::endl;
 
 		d.objects.iterate([&](object_id_t i, uri_t const& uri) {
@@ -93,8 +91,8 @@ public:
 			})();
 
 			auto print_dep_obj_f = ([&](dependency_id_t const d_id, bool /*print_failure*/) {
-				auto it = depmap.find(d_id);
-				if (it == depmap.end()) {
+				auto const o_id = d.dependency_objects[d_id];
+				if (!o_id) {
 					std::stringstream ss;
 					ss << "nope ";
 					uri_t u = d.dependencies[d_id];
@@ -106,7 +104,7 @@ public:
 					return ss.str();
 				}
 				std::stringstream sstr;
-				sstr << "(obj " << it->second.unseal() << ") ";
+				sstr << "(obj " << o_id->unseal() << ") ";
 
 				return sstr.str();
 			});
@@ -3,9 +3,7 @@
 #include <roerei/util/performance.hpp>
 #include <roerei/generic/multitask.hpp>
 
-size_t roerei::multitask::jobset_t::jobset_count = 0;
-
-register_performance
+std::atomic<size_t> roerei::multitask::jobset_t::jobset_count(0);
 
 int main(int argc, char** argv)
 {
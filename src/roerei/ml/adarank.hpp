@@ -9,18 +9,25 @@
 #include <roerei/generic/encapsulated_array.hpp>
 #include <roerei/generic/encapsulated_vector.hpp>
 #include <roerei/generic/id_t.hpp>
+#include <roerei/generic/multitask.hpp>
 #include <roerei/generic/set_operations.hpp>
 
 #include <roerei/generic/common.hpp>
 
+#include <roerei/util/fast_log.hpp>
+
 #include <algorithm>
 #include <cstdint>
+#include <exception>
 #include <functional>
+#include <thread>
+#include <vector>
 
 namespace roerei
 {
 
-class adarank
+template<typename LOG>
+class basic_adarank
 {
 private:
 	struct t_t : public id_t<t_t>
@@ -44,6 +51,7 @@ public:
 
 	struct feature_requirements_t {
 		compact_sparse_matrix_t<document_id_t, feature_id_t, float> document_query_summary;
+		encapsulated_vector<feature_id_t, size_t> frequencies;
 		encapsulated_vector<feature_id_t, float> idf;
 		encapsulated_vector<feature_id_t, float> cwic;
 
@@ -51,22 +59,82 @@ public:
 		float C_sum;
 	};
 
+	/* Feature requirements of the fold, without the objects excluded for a single test row.
+	 * Only the documents which were used by the excluded objects are stored.
+	 */
+	struct adjusted_feature_requirements_t {
+		std::map<document_id_t, std::vector<std::pair<feature_id_t, float>>> documents;
+		encapsulated_vector<feature_id_t, float> idf;
+		encapsulated_vector<feature_id_t, float> cwic;
+
+		encapsulated_vector<document_id_t, float> d_sums;
+		float C_sum;
+	};
+
+	/* Arguments of the logarithms of compute_features, gathered per document */
+	struct feature_buffers_t {
+		std::vector<float> frequency, cwic_div, idf, cwid_frac, cwid_frac_idf, cwid_cwic;
+
+		void clear()
+		{
+			frequency.clear();
+			cwic_div.clear();
+			idf.clear();
+			cwid_frac.clear();
+			cwid_frac_idf.clear();
+			cwid_cwic.clear();
+		}
+
+		static float sum(std::vector<float> const& xs)
+		{
+			float sum = 0.0f;
+			for(float x : xs)
+				sum += x;
+			return sum;
+		}
+	};
+
 private:
+	/* Feature vectors of the documents sharing at least one feature with the query, sorted by document.
+	 * All other documents have the feature vector default_features().
+	 */
+	typedef std::vector<std::pair<document_id_t, feature_vector_t>> sparse_feature_row_t;
+
 	struct intermediaries_t {
 		std::vector<query_id_t> queries;
-		full_matrix_t<query_id_t, document_id_t, feature_vector_t> features;
+		encapsulated_vector<query_id_t, sparse_feature_row_t> features;
 		full_matrix_t<ir_feature_id_t, query_id_t, float> E_weak_cached;
 		full_matrix_t<t_t, query_id_t, float> p;
 	};
 
+	/* Scratch space of a single thread when measuring rankings */
+	struct query_buffers_t {
+		performance::oocover_buffer_t oocover;
+		ranking_t ranking;
+
+		query_buffers_t(dataset_t const& d)
+			: oocover(d)
+			, ranking()
+		{
+			ranking.reserve(d.dependencies.size());
+		}
+	};
+
 private:
 	size_t const T;
+	size_t const threads;
 	dataset_t const& d;
 
+	// Trainingset of the fold, and its feature requirements
+	compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> fold_trainingset;
+	std::vector<object_id_t> fold_objects;
+	feature_requirements_t fold_fr;
+
 	encapsulated_vector<t_t, ir_feature_id_t> h;
 	encapsulated_vector<t_t, float> alpha;
 
-private:
+public:
+	// Summed feature rows of the objects in the trainingset which use each document
 	template<typename MATRIX>
 	static sparse_matrix_t<document_id_t, feature_id_t, float> create_dqs(dataset_t const& d, MATRIX const& trainingset)
 	{
@@ -75,14 +143,15 @@ private:
 		auto dependants = dependencies::create_dependants(d);
 		d.dependencies.keys([&](dependency_id_t dep_id) {
 			dependants.citerate(dep_id, [&](object_id_t const obj_id) {
-				try {
-					for (std::pair<feature_id_t, float> kvp : trainingset[obj_id]) {
-						if (kvp.second > 0.0f) {
-							document_query_summary[dep_id][kvp.first] += kvp.second;
-						}
+				auto const row = trainingset.try_row(obj_id);
+				if (!row) {
+					return; // Not in the trainingset
+				}
+
+				for (std::pair<feature_id_t, float> kvp : *row) {
+					if (kvp.second > 0.0f) {
+						document_query_summary[dep_id][kvp.first] += kvp.second;
 					}
-				} catch (std::out_of_range) {
-					// Do nothing
 				}
 			});
 		});
@@ -90,7 +159,8 @@ private:
 		return document_query_summary;
 	}
 
-	static encapsulated_vector<feature_id_t, float> create_idf(dataset_t const& d, decltype(feature_requirements_t::document_query_summary) const& dqs)
+private:
+	static encapsulated_vector<feature_id_t, size_t> create_frequencies(dataset_t const& d, decltype(feature_requirements_t::document_query_summary) const& dqs)
 	{
 		encapsulated_vector<feature_id_t, size_t> frequencies(d.features.size());
 		dqs.citerate([&](auto const& row) {
@@ -100,16 +170,44 @@ private:
 				}
 			}
 		});
+		return frequencies;
+	}
 
-		encapsulated_vector<feature_id_t, float> idf(d.features.size());
+	static float compute_idf(dataset_t const& d, size_t frequency)
+	{
 		float N = d.dependencies.size();
+		return std::log(N / static_cast<float>(frequency + 1));
+	}
+
+	static encapsulated_vector<feature_id_t, float> create_idf(dataset_t const& d, encapsulated_vector<feature_id_t, size_t> const& frequencies)
+	{
+		encapsulated_vector<feature_id_t, float> idf(d.features.size());
 		feature_id_t::iterate([&](feature_id_t fid) {
-			idf[fid] = std::log(N / static_cast<float>(frequencies[fid] + 1));
+			idf[fid] = compute_idf(d, frequencies[fid]);
 		}, d.features.size());
 
 		return idf;
 	}
 
+	static float compute_C_sum(encapsulated_vector<feature_id_t, float> const& cwic)
+	{
+		float C_sum = 0.0f;
+		cwic.iterate([&](feature_id_t, float x) {
+			C_sum += x;
+		});
+		return C_sum;
+	}
+
+	template<typename DOCUMENT>
+	static float compute_d_sum(DOCUMENT const& document)
+	{
+		float d_sum = 0.0f;
+		for (auto const& kvp : document) {
+			d_sum += kvp.second;
+		}
+		return d_sum;
+	}
+
 	static encapsulated_vector<feature_id_t, float> create_cwic(dataset_t const& d, decltype(feature_requirements_t::document_query_summary) const& dqs)
 	{
 		encapsulated_vector<feature_id_t, float> cwic(d.features.size());
@@ -125,27 +223,20 @@ public:
 	template<typename MATRIX>
 	static feature_requirements_t create_feature_requirements(dataset_t const& d, MATRIX const& trainingset) {
 		auto dqs = create_dqs(d, trainingset);
-		auto idf = create_idf(d, dqs);
+		auto frequencies = create_frequencies(d, dqs);
+		auto idf = create_idf(d, frequencies);
 		auto cwic = create_cwic(d, dqs);
-
-		float C_sum = 0.0f;
-		cwic.iterate([&](feature_id_t, float x) {
-			C_sum += x;
-		});
+		float C_sum = compute_C_sum(cwic);
 
 		encapsulated_vector<document_id_t, float> d_sums;
 		d_sums.reserve(d.dependencies.size());
 		d.dependencies.keys([&](document_id_t d_id) {
-			auto const& document(dqs[d_id]);
-			float d_sum = 0.0f;
-			for (auto const& kvp : document) {
-				d_sum += kvp.second;
-			}
-			d_sums.emplace_back(d_sum);
+			d_sums.emplace_back(compute_d_sum(dqs[d_id]));
 		});
 
 		return {
 			std::move(dqs),
+			std::move(frequencies),
 			std::move(idf),
 			std::move(cwic),
 			std::move(d_sums),
@@ -154,36 +245,58 @@ public:
 	}
 
 private:
-	template<typename FEATURES>
-	feature_vector_t compute_features(feature_requirements_t const& fr, FEATURES const& query, document_id_t d_id) const {
-		auto document = fr.document_query_summary[d_id];
+	template<typename MATRIX>
+	static std::vector<object_id_t> create_objects(MATRIX const& trainingset)
+	{
+		std::vector<object_id_t> objects;
+		trainingset.citerate([&](auto const& row) {
+			objects.emplace_back(row.row_i);
+		});
+		return objects;
+	}
 
-		float d_sum = fr.d_sums[d_id];
+	// Documents in which each feature occurs
+	static encapsulated_vector<feature_id_t, std::vector<document_id_t>> create_feature_documents(dataset_t const& d, feature_requirements_t const& fr)
+	{
+		encapsulated_vector<feature_id_t, std::vector<document_id_t>> feature_documents(d.features.size());
+		fr.document_query_summary.citerate([&](auto const& row) {
+			for (std::pair<feature_id_t, float> kvp : row) {
+				feature_documents[kvp.first].emplace_back(row.row_i);
+			}
+		});
+		return feature_documents;
+	}
+
+	// Result of compute_features for a document without any feature of the query
+	static feature_vector_t default_features()
+	{
+		return feature_vector_t(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, LOG::log(0.0f));
+	}
+
+	// FR is either feature_requirements_t or adjusted_feature_requirements_t
+	template<typename FR, typename DOCUMENT, typename FEATURES>
+	feature_vector_t compute_features(FR const& fr, DOCUMENT const& document, float d_sum, FEATURES const& query, feature_buffers_t& buffers) const {
 
-		float frequency_sum = 0.0f;
-		float cwic_div_sum = 0.0f;
-		float idf_sum = 0.0f;
-		float cwid_frac_sum = 0.0f;
-		float cwid_frac_idf_sum = 0.0f;
-		float cwid_cwic_sum = 0.0f;
 		float bmtwentyfive = 0.0f;
 
 		float constexpr kone = 1.5f;
 		float constexpr b = 0.75f;
 
-		float const fraction = kone * (1.0f - b + b * (d_sum / (fr.C_sum / static_cast<float>(fr.document_query_summary.size_m()))));
+		buffers.clear();
+
+		float const fraction = kone * (1.0f - b + b * (d_sum / (fr.C_sum / static_cast<float>(d.dependencies.size()))));
 		set_compute_smart_intersect(
 			document.begin(), document.end(), get_nonempty_size(document),
 			query.begin(), query.end(), get_nonempty_size(query),
 			[](auto const& df) { return df.first; },
 			[](auto const& qf) { return qf.first; },
 			[&](auto const& df, auto const& /*qf*/) {
-				frequency_sum += std::log1p(df.second);
-				cwic_div_sum += std::log1p(fr.C_sum / fr.cwic[df.first]);
-				idf_sum += std::log(fr.idf[df.first]);
-				cwid_frac_sum += std::log1p(df.second / d_sum);
-				cwid_frac_idf_sum += std::log1p(df.second / d_sum + fr.idf[df.first]);
-				cwid_cwic_sum += std::log1p( (df.second * fr.C_sum) / (d_sum * fr.cwic[df.first]));
+				buffers.frequency.emplace_back(df.second);
+				buffers.cwic_div.emplace_back(fr.C_sum / fr.cwic[df.first]);
+				buffers.idf.emplace_back(fr.idf[df.first]);
+				buffers.cwid_frac.emplace_back(df.second / d_sum);
+				buffers.cwid_frac_idf.emplace_back(df.second / d_sum + fr.idf[df.first]);
+				buffers.cwid_cwic.emplace_back((df.second * fr.C_sum) / (d_sum * fr.cwic[df.first]));
 
 				bmtwentyfive +=
 						fr.idf[df.first] *
@@ -194,17 +307,135 @@ private:
 			}
 		);
 
+		size_t const n = buffers.frequency.size();
+		LOG::log1p(buffers.frequency.data(), n);
+		LOG::log1p(buffers.cwic_div.data(), n);
+		LOG::log(buffers.idf.data(), n);
+		LOG::log1p(buffers.cwid_frac.data(), n);
+		LOG::log1p(buffers.cwid_frac_idf.data(), n);
+		LOG::log1p(buffers.cwid_cwic.data(), n);
+
 		return feature_vector_t(
-			frequency_sum,
-			cwic_div_sum,
-			idf_sum,
-			cwid_frac_sum,
-			cwid_frac_idf_sum,
-			cwid_cwic_sum,
-			std::log(bmtwentyfive)
+			feature_buffers_t::sum(buffers.frequency),
+			feature_buffers_t::sum(buffers.cwic_div),
+			feature_buffers_t::sum(buffers.idf),
+			feature_buffers_t::sum(buffers.cwid_frac),
+			feature_buffers_t::sum(buffers.cwid_frac_idf),
+			feature_buffers_t::sum(buffers.cwid_cwic),
+			LOG::log(bmtwentyfive)
 		);
 	}
 
+	// Objects of the fold which are not in the trainingset; the trainingset is a subset of the fold
+	template<typename TRAININGSET>
+	std::vector<object_id_t> find_excluded(TRAININGSET const& trainingset, size_t& included) const
+	{
+		std::vector<object_id_t> excluded;
+		included = 0;
+
+		auto it = fold_objects.begin();
+		trainingset.citerate([&](auto const& row) {
+			for (; it != fold_objects.end() && *it < row.row_i; ++it) {
+				excluded.emplace_back(*it);
+			}
+
+			if (it != fold_objects.end() && *it == row.row_i) {
+				++it;
+			}
+
+			included++;
+		});
+		excluded.insert(excluded.end(), it, fold_objects.end());
+
+		return excluded;
+	}
+
+	adjusted_feature_requirements_t adjust_feature_requirements(std::vector<object_id_t> const& excluded) const
+	{
+		// Contributions of the excluded objects to the document query summary
+		std::map<document_id_t, std::map<feature_id_t, float>> removed;
+		for (object_id_t obj_id : excluded) {
+			auto const& row = fold_trainingset[obj_id];
+			for (auto const& dep_kvp : d.dependency_matrix[obj_id]) {
+				if (dep_kvp.second <= 0) {
+					continue;
+				}
+
+				auto& document_removed = removed[dep_kvp.first];
+				for (std::pair<feature_id_t, float> kvp : row) {
+					if (kvp.second > 0.0f) {
+						document_removed[kvp.first] += kvp.second;
+					}
+				}
+			}
+		}
+
+		adjusted_feature_requirements_t result{
+			{},
+			fold_fr.idf,
+			fold_fr.cwic,
+			fold_fr.d_sums,
+			0.0f
+		};
+
+		encapsulated_vector<feature_id_t, size_t> frequencies(fold_fr.frequencies);
+		std::vector<feature_id_t> changed_frequencies;
+
+		for (auto const& removed_kvp : removed) {
+			document_id_t const d_id = removed_kvp.first;
+			auto const& document = fold_fr.document_query_summary[d_id];
+
+			std::vector<std::pair<feature_id_t, float>> adjusted_document;
+			adjusted_document.reserve(get_nonempty_size(document));
+
+			auto removed_it = removed_kvp.second.begin();
+			for (std::pair<feature_id_t, float> kvp : document) {
+				for (; removed_it != removed_kvp.second.end() && removed_it->first < kvp.first; ++removed_it) {}
+
+				if (removed_it != removed_kvp.second.end() && removed_it->first == kvp.first) {
+					result.cwic[kvp.first] -= removed_it->second;
+					kvp.second -= removed_it->second;
+				}
+
+				if (kvp.second > 0.0f) {
+					adjusted_document.emplace_back(kvp);
+				} else {
+					frequencies[kvp.first]--;
+					changed_frequencies.emplace_back(kvp.first);
+				}
+			}
+
+			result.d_sums[d_id] = compute_d_sum(adjusted_document);
+			result.documents.emplace(d_id, std::move(adjusted_document));
+		}
+
+		for (feature_id_t f_id : changed_frequencies) {
+			result.idf[f_id] = compute_idf(d, frequencies[f_id]);
+		}
+
+		result.C_sum = compute_C_sum(result.cwic);
+
+		return result;
+	}
+
+	template<typename ROW, typename FR, typename DOCUMENT_F>
+	ranking_t rank(ROW const& test_row, FR const& fr, DOCUMENT_F const& document_f) const
+	{
+		ranking_t ranking;
+		feature_buffers_t feature_buffers;
+
+		d.dependencies.keys([&](document_id_t d_id) {
+			document_f(d_id, [&](auto const& document) {
+				float f = compute_f(T-1, compute_features(fr, document, fr.d_sums[d_id], test_row, feature_buffers));
+				if (f >= 0.0f) {
+					ranking.emplace_back(std::make_pair(d_id, f));
+				}
+			});
+		});
+
+		return ranking;
+	}
+
 	float compute_E(ranking_t const& ranking, object_id_t test_row_i, performance::oocover_buffer_t& buffer) const
 	{
 		return performance::measure_oocover(d, test_row_i, ranking, buffer); // Metric we want to maximize
@@ -220,22 +451,90 @@ private:
 		return result;
 	}
 
+	// Calls f with the feature vector of every document, in order of document
+	template<typename F>
+	void iterate_features(intermediaries_t const& inter, query_id_t q_id, feature_vector_t const& default_vector, F const& f) const
+	{
+		auto it = inter.features[q_id].begin();
+		auto const end = inter.features[q_id].end();
+		d.dependencies.keys([&](dependency_id_t d_id) {
+			if (it != end && it->first == d_id) {
+				f(d_id, it->second);
+				++it;
+			} else {
+				f(d_id, default_vector);
+			}
+		});
+	}
+
 	void create_ranking_weak(intermediaries_t const& inter, query_id_t q_id, ir_feature_id_t k, ranking_t& ranking) const
 	{
 		ranking.clear();
-		d.dependencies.keys([&](dependency_id_t d_id) {
-			ranking.emplace_back(std::make_pair(d_id, inter.features[q_id][d_id][k]));
+		iterate_features(inter, q_id, default_features(), [&](dependency_id_t d_id, feature_vector_t const& fv) {
+			ranking.emplace_back(std::make_pair(d_id, fv[k]));
 		});
 	}
 
 	void create_ranking_strong(intermediaries_t const& inter, query_id_t q_id, t_t t, ranking_t& ranking) const
 	{
 		ranking.clear();
-		d.dependencies.keys([&](dependency_id_t d_id) {
-			ranking.emplace_back(std::make_pair(d_id, compute_f(t, inter.features[q_id][d_id])));
+		iterate_features(inter, q_id, default_features(), [&](dependency_id_t d_id, feature_vector_t const& fv) {
+			ranking.emplace_back(std::make_pair(d_id, compute_f(t, fv)));
 		});
 	}
 
+	/* Calls f for every query, with the queries divided in contiguous blocks over at most the given number
+	 * of threads; besides the calling thread, only the idle workers of the surrounding multitask are used.
+	 * Plain threads are used instead of a multitask, as these are called from within the jobs of a
+	 * multitask, and should not show up in its progress and events.
+	 */
+	template<typename F>
+	void iterate_queries(std::vector<query_id_t> const& queries, F const& f) const
+	{
+		size_t const borrowed = threads <= 1 || queries.size() <= 1 ? 0 : multitask::borrow(std::min(threads, queries.size()) - 1);
+		if (borrowed == 0) {
+			query_buffers_t buffers(d);
+			for (query_id_t i : queries) {
+				f(i, buffers);
+			}
+			return;
+		}
+
+		size_t const n = 1 + borrowed;
+		std::vector<std::exception_ptr> errors(n);
+		auto const block_f = [&](size_t j) {
+			try {
+				query_buffers_t buffers(d);
+				auto const begin = queries.begin() + (j * queries.size()) / n;
+				auto const end = queries.begin() + ((j + 1) * queries.size()) / n;
+				for (auto it = begin; it != end; ++it) {
+					f(*it, buffers);
+				}
+			} catch (...) {
+				errors[j] = std::current_exception();
+			}
+		};
+
+		// The first block is run by the calling thread
+		std::vector<std::thread> workers;
+		workers.reserve(n - 1);
+		for (size_t j = 1; j < n; ++j) {
+			workers.emplace_back(block_f, j);
+		}
+		block_f(0);
+
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		multitask::give_back(borrowed);
+
+		for (auto const& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	}
+
 	ir_feature_id_t compute_h(intermediaries_t const& inter, t_t t) const
 	{
 		ir_feature_id_t result_k = ir_feature_size; // Non-existing feature
@@ -294,57 +593,71 @@ private:
 	}
 
 public:
-	adarank(adarank const&) = delete;
-	adarank(adarank&&) = default;
+	basic_adarank(basic_adarank const&) = delete;
+	basic_adarank(basic_adarank&&) = default;
 
 	template<typename ORIG_MATRIX>
-	adarank(
+	basic_adarank(
 			size_t _T,
 			dataset_t const& _d,
-			ORIG_MATRIX const& trainingset
+			ORIG_MATRIX const& trainingset,
+			size_t _threads = 1
 			)
 		: T(_T)
+		, threads(_threads)
 		, d(_d)
+		, fold_trainingset(trainingset)
+		, fold_objects(create_objects(fold_trainingset))
+		, fold_fr(create_feature_requirements(d, fold_trainingset))
 		, h(T, ir_feature_size) // Initialize with non existing feature
 		, alpha(T)
 	{
-		auto fr = create_feature_requirements(d, trainingset);
+		auto const& fr = fold_fr;
 
 		std::cout << "Requirements computed" << std::endl;
 
 		intermediaries_t inter{
 			std::vector<query_id_t>(),
-			full_matrix_t<query_id_t, document_id_t, feature_vector_t>(d.objects.size(), d.dependencies.size()),
+			encapsulated_vector<query_id_t, sparse_feature_row_t>(d.objects.size()),
 			full_matrix_t<ir_feature_id_t, query_id_t, float>(ir_feature_size, d.objects.size()),
 			full_matrix_t<t_t, query_id_t, float>(T, d.objects.size())
 		};
 
+		auto const feature_documents = create_feature_documents(d, fr);
+
 		std::vector<std::pair<feature_id_t, float>> query_row;
+		std::vector<document_id_t> documents;
+		feature_buffers_t feature_buffers;
 		trainingset.citerate([&](auto const& original_row) {
 			query_row.clear();
+			documents.clear();
 
 			for (auto const& kvp : original_row) {
 				query_row.emplace_back(kvp);
+
+				auto const& xs = feature_documents[kvp.first];
+				documents.insert(documents.end(), xs.begin(), xs.end());
 			}
 
-			auto&& row = inter.features[original_row.row_i];
-			d.dependencies.keys([&](document_id_t d_id) {
-				row[d_id] = compute_features(fr, query_row, d_id);
-			});
+			std::sort(documents.begin(), documents.end());
+			documents.erase(std::unique(documents.begin(), documents.end()), documents.end());
+
+			auto& row = inter.features[original_row.row_i];
+			row.reserve(documents.size());
+			for (document_id_t d_id : documents) {
+				row.emplace_back(d_id, compute_features(fr, fr.document_query_summary[d_id], fr.d_sums[d_id], query_row, feature_buffers));
+			}
 
 			inter.queries.emplace_back(original_row.row_i);
 		});
 
-		performance::oocover_buffer_t oocover_buffer(d);
-		ranking_t ranking_buffer;
-		ranking_buffer.reserve(d.dependencies.size());
-
-		ir_feature_id_t::iterate([&](ir_feature_id_t k) {
-			for (query_id_t i : inter.queries) {
-				create_ranking_weak(inter, i, k, ranking_buffer);
-				inter.E_weak_cached[k][i] = compute_E(ranking_buffer, i, oocover_buffer);
-			}
-		}, ir_feature_size);
+		// Every query only writes its own column of E_weak_cached
+		iterate_queries(inter.queries, [&](query_id_t i, query_buffers_t& buffers) {
+			ir_feature_id_t::iterate([&](ir_feature_id_t k) {
+				create_ranking_weak(inter, i, k, buffers.ranking);
+				inter.E_weak_cached[k][i] = compute_E(buffers.ranking, i, buffers.oocover);
+			}, ir_feature_size);
+		});
 
 		const float m = inter.queries.size();
 		for (query_id_t i : inter.queries) {
@@ -364,12 +677,15 @@ public:
 			}
 
 			encapsulated_vector<object_id_t, float> strong_E(d.objects.size());
+			iterate_queries(inter.queries, [&](query_id_t i, query_buffers_t& buffers) {
+				create_ranking_strong(inter, i, t, buffers.ranking);
+				strong_E[i] = std::exp(-1.0f * compute_E(buffers.ranking, i, buffers.oocover));
+			});
+
+			// Summed in order of query, independent of the number of threads
 			float sum_strong_E = 0.0f;
 			for (query_id_t i : inter.queries) {
-				create_ranking_strong(inter, i, t, ranking_buffer);
-				float sei = std::exp(-1.0f * compute_E(ranking_buffer, i, oocover_buffer));
-				strong_E[i] = sei;
-				sum_strong_E += sei;
+				sum_strong_E += strong_E[i];
 			}
 			std::cout << "sum strong_E: " << sum_strong_E << std::endl;
 
@@ -379,23 +695,57 @@ public:
 		}, T);
 	}
 
+	// How predict derives the feature requirements of its trainingset from those of the fold; all yield the same ranking
+	enum class requirements_e
+	{
+		automatic, // Whichever is cheaper
+		adjusted,
+		scratch
+	};
+
+	// Features of a document of the fold for a query, as ranked by predict when no objects are excluded
+	template<typename FEATURES>
+	feature_vector_t fold_features(document_id_t d_id, FEATURES const& query, feature_buffers_t& buffers) const
+	{
+		return compute_features(fold_fr, fold_fr.document_query_summary[d_id], fold_fr.d_sums[d_id], query, buffers);
+	}
+
+	// The trainingset must be a subset of the trainingset the model was trained with
 	template<typename ROW, typename TRAININGSET>
-	std::vector<std::pair<dependency_id_t, float>> predict(ROW const& test_row, TRAININGSET const& trainingset) const
+	std::vector<std::pair<dependency_id_t, float>> predict(ROW const& test_row, TRAININGSET const& trainingset, requirements_e requirements = requirements_e::automatic) const
 	{
-		feature_requirements_t fr(create_feature_requirements(d, trainingset));
+		size_t included;
+		auto const excluded(find_excluded(trainingset, included));
 
-		ranking_t ranking;
+		if (excluded.empty() && requirements != requirements_e::scratch) {
+			return rank(test_row, fold_fr, [&](document_id_t d_id, auto const& f) {
+				f(fold_fr.document_query_summary[d_id]);
+			});
+		}
 
-		d.dependencies.keys([&](document_id_t d_id) {
-			float f = compute_f(T-1, compute_features(fr, test_row, d_id));
-			if (f >= 0.0f) {
-				ranking.emplace_back(std::make_pair(d_id, f));
+		// Adjusting costs about as much as building from scratch when most of the fold is excluded
+		if (requirements == requirements_e::scratch || (requirements == requirements_e::automatic && excluded.size() > included)) {
+			feature_requirements_t const fr(create_feature_requirements(d, trainingset));
+			return rank(test_row, fr, [&](document_id_t d_id, auto const& f) {
+				f(fr.document_query_summary[d_id]);
+			});
+		}
+
+		adjusted_feature_requirements_t const fr(adjust_feature_requirements(excluded));
+		return rank(test_row, fr, [&](document_id_t d_id, auto const& f) {
+			auto it = fr.documents.find(d_id);
+			if (it != fr.documents.end()) {
+				f(it->second);
+			} else {
+				f(fold_fr.document_query_summary[d_id]);
 			}
 		});
-
-		return ranking;
 	}
 };
 
-}
+template<typename LOG>
+constexpr size_t basic_adarank<LOG>::ir_feature_size;
 
+typedef basic_adarank<default_log_t> adarank;
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <roerei/performance.hpp>
+#include <roerei/trace.hpp>
 #include <roerei/partition.hpp>
 #include <roerei/dataset.hpp>
 #include <roerei/dependencies.hpp>
@@ -11,10 +12,14 @@
 #include <roerei/generic/compact_sparse_matrix.hpp>
 #include <roerei/generic/bl_sparse_matrix.hpp>
 
+#include <roerei/util/events.hpp>
 #include <roerei/util/performance.hpp>
 
+#include <chrono>
 #include <iostream>
 #include <functional>
+#include <map>
+#include <set>
 
 namespace roerei
 {
@@ -107,23 +112,68 @@ public:
 
 	typedef compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> const trainset_t;
 	typedef compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t>::const_row_proxy_t testrow_t;
-	typedef std::function<performance::result_t(trainset_t const&, testrow_t const&)> ml_f_t;
+	typedef std::function<std::vector<std::pair<dependency_id_t, float>>(trainset_t const&, testrow_t const&)> ml_f_t;
 
+	/* The metrics of the folds of a jobset which were done earlier, and fold_f which is called with the
+	 * metrics of every fold as it is done, such that an interrupted jobset can be resumed.
+	 */
+	struct checkpoint_t
+	{
+		std::map<size_t, performance::metrics_t> done;
+		std::function<void(size_t, performance::metrics_t const&)> fold_f;
+	};
+
+	size_t folds() const
+	{
+		size_t count = 0;
+		combs(n, n-k, [&](std::vector<size_t> const&) {
+			count++;
+		});
+		return count;
+	}
+
+	/* The jobset is announced by name in the event stream, and when trace_sink is set the results
+	 * of every test row are written to trace_dir/name.trace
+	 *
+	 * Only the folds which are not in checkpoint.done are run, and thus traced; the trace keeps the rows of
+	 * the folds which were done earlier. When all folds are done, the result is yielded at once.
+	 */
 	template<typename ML_F, typename RESULT_F>
-	void order_async(multitask& m, ML_F const& init_f, RESULT_F const& result_f, dataset_t const& d, bool prior = true, bool silent = false) const
+	void order_async(multitask& m, ML_F const& init_f, RESULT_F const& result_f, dataset_t const& d, bool prior = true, bool silent = false, std::string const& name = std::string(), trace::sink_t* trace_sink = nullptr, std::string const& trace_dir = std::string(), checkpoint_t const& checkpoint = checkpoint_t()) const
 	{
+		std::shared_ptr<trace::file_t> trace_file;
+		if(trace_sink)
+		{
+			std::set<size_t> done_folds;
+			for(auto const& kvp : checkpoint.done)
+				done_folds.emplace(kvp.first);
+
+			trace_file = trace_sink->open(trace_dir + "/" + name + ".trace", name, trace::default_top_n, done_folds);
+		}
+
 		std::vector<std::packaged_task<void()>> tasks;
-		std::vector<std::future<performance::metrics_t>> future_metrics;
+		std::vector<std::future<performance::metrics_accumulator_t>> future_metrics;
 
 		size_t i = 0;
 		combs(n, n-k, [&](std::vector<size_t> const& train_ps) {
-			std::promise<performance::metrics_t> p;
+			std::promise<performance::metrics_accumulator_t> p;
 			future_metrics.emplace_back(p.get_future());
 
-			tasks.emplace_back([&d, init_f, prior, silent, i, train_ps, cv_static_ptr=this->cv_static_ptr, p=std::move(p), n=n]() mutable {
+			auto const done_it = checkpoint.done.find(i);
+			if(done_it != checkpoint.done.end())
+			{
+				performance::metrics_accumulator_t fm;
+				fm += done_it->second;
+				p.set_value(std::move(fm));
+				i++;
+				return;
+			}
+
+			tasks.emplace_back([&d, init_f, prior, silent, trace_sink, trace_file, fold_f=checkpoint.fold_f, i, train_ps, cv_static_ptr=this->cv_static_ptr, p=std::move(p), n=n]() mutable {
 				auto const& s = *cv_static_ptr;
 
 				test::performance::init();
+				auto const start = std::chrono::steady_clock::now();
 
 				sliced_sparse_matrix_t<decltype(s.feature_matrix) const> train_m_tmp(s.feature_matrix, false), test_m_tmp(s.feature_matrix, false);
 				if (n == 1) {
@@ -145,32 +195,56 @@ public:
 				});
 
 				compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> const train_m(train_m_tmp), test_m(test_m_tmp);
+				size_t const train_rows = train_m_tmp.nonempty_size_m(), test_rows = test_m_tmp.nonempty_size_m();
 				std::cerr << "prior " << d.prior_objects.size() << std::endl;
-				{
-					size_t c = 0;
-					train_m.citerate([&c](auto) {
-						c++;
-					});
-					std::cerr << "train_m_tmp " << c << std::endl;
-				}
-				{
-					size_t c = 0;
-					test_m.citerate([&c](auto) {
-						c++;
-					});
-					std::cerr << "test_m_tmp " << c << std::endl;
-				}
+				std::cerr << "train_m_tmp " << train_rows << std::endl;
+				std::cerr << "test_m_tmp " << test_rows << std::endl;
+
+				performance::metrics_accumulator_t fm;
+				performance::measure_buffer_t measure_buffer(d);
 
-				performance::metrics_t fm;
+				trace::block_t trace_block;
+				std::vector<std::pair<dependency_id_t, float>> trace_buffer;
 
+				auto const test_start = std::chrono::steady_clock::now();
 				{
 					performance_scope("citerate")
 					auto&& ml_f = init_f(train_m);
 					test_m.citerate([&](testrow_t const& test_row) {
-						fm += ml_f(test_row).metrics;
+						auto const suggestions(ml_f(test_row));
+						auto const metrics(performance::measure_metrics(d, test_row.row_i, suggestions, measure_buffer));
+						fm += metrics;
+
+						if(!trace_sink)
+							return;
+
+						trace_block.add(i, test_row.row_i, metrics, suggestions, trace_file->top_n, trace_buffer);
+						if(trace_block.size() >= trace::default_block_size)
+						{
+							trace_sink->submit(trace_file, std::move(trace_block));
+							trace_block = trace::block_t();
+						}
 					});
 				}
 
+				if(trace_sink)
+					trace_sink->submit(trace_file, std::move(trace_block));
+
+				if(fold_f)
+					fold_f(i, fm.metrics());
+
+				if(events::enabled())
+				{
+					auto const end = std::chrono::steady_clock::now();
+					double const test_duration = std::chrono::duration<double>(end - test_start).count();
+					events::emit(events::event_t("fold")("jobset", multitask::jobset())("fold", i)
+						("train_rows", train_rows)("test_rows", test_rows)
+						("duration", std::chrono::duration<double>(end - start).count())
+						("test_duration", test_duration)
+						("rows_per_sec", test_duration > 0.0 ? test_rows / test_duration : 0.0)
+						("peak_rss_kb", events::peak_rss_kb()));
+				}
+
 				if(!silent)
 				{
 					std::cout << i << ": " << fm << std::endl;
@@ -184,20 +258,35 @@ public:
 			i++;
 		});
 
-		std::packaged_task<void()> continuation([future_metrics=std::move(future_metrics), result_f]() mutable
+		std::packaged_task<void()> continuation([future_metrics=std::move(future_metrics), result_f, silent, trace_sink, trace_file]() mutable
 		{
-			performance::metrics_t total_metrics;
+			performance::metrics_accumulator_t total_metrics;
 
-			for(auto& fut_m : future_metrics)
+			for(auto& fut_m : future_metrics) // In order of fold
 				total_metrics += fut_m.get();
 
-			result_f(total_metrics);
+			if(trace_sink)
+				trace_sink->close(trace_file);
+
+			if(!silent)
+				std::cout << "total: " << total_metrics << std::endl;
+
+			result_f(total_metrics.metrics());
 		});
 
-		m.add({
+		if(tasks.empty())
+		{
+			continuation(); // All folds were done earlier
+			return;
+		}
+
+		size_t const folds = tasks.size();
+		size_t const jobset = m.add({
 			std::move(tasks),
 			std::move(continuation)
 		});
+
+		events::emit(events::event_t("jobset")("jobset", jobset)("name", name)("folds", folds));
 	}
 };
 
@@ -40,6 +40,20 @@ private:
 	MATRIX const& trainingset;
 	dataset_t const& d;
 
+	std::vector<std::pair<dependency_id_t, float>> suggest(best_set_t const& set) const
+	{
+		std::map<dependency_id_t, float> suggestions;
+		for(auto const& kvp : set.items)
+		{
+			float weight = 1.0f / (kvp.second + 1.0f); // "Similarity", higher is more similar
+
+			for(auto dep_kvp : d.dependency_matrix[kvp.first])
+				suggestions[dep_kvp.first] += static_cast<float>(dep_kvp.second) * weight;
+		}
+
+		return std::vector<std::pair<dependency_id_t, float>>(suggestions.begin(), suggestions.end());
+	}
+
 public:
 	knn(size_t const _k, MATRIX const& _trainingset, dataset_t const& _d)
 		: k(_k)
@@ -57,16 +71,29 @@ public:
 			set.try_add(std::make_pair(xs.row_i, dist));
 		});
 
-		std::map<dependency_id_t, float> suggestions;
-		for(auto const& kvp : set.items)
-		{
-			float weight = 1.0f / (kvp.second + 1.0f); // "Similarity", higher is more similar
+		return suggest(set);
+	}
 
-			for(auto dep_kvp : d.dependency_matrix[kvp.first])
-				suggestions[dep_kvp.first] += static_cast<float>(dep_kvp.second) * weight;
-		}
+	// Predicts for all rows in a single pass over the trainingset
+	template<typename ROW>
+	std::vector<std::vector<std::pair<dependency_id_t, float>>> predict_batch(std::vector<ROW> const& yss) const
+	{
+		std::vector<best_set_t> sets(yss.size(), best_set_t(k));
 
-		return std::vector<std::pair<dependency_id_t, float>>(suggestions.begin(), suggestions.end());
+		trainingset.citerate([&](typename MATRIX::const_row_proxy_t const& xs) {
+			for(size_t i = 0; i < yss.size(); ++i)
+			{
+				float dist = distance::euclidean<decltype(xs.begin()->second), decltype(xs), ROW>(xs, yss[i]);
+				sets[i].try_add(std::make_pair(xs.row_i, dist));
+			}
+		});
+
+		std::vector<std::vector<std::pair<dependency_id_t, float>>> result;
+		result.reserve(sets.size());
+		for(auto const& set : sets)
+			result.emplace_back(suggest(set));
+
+		return result;
 	}
 };
 
@@ -2,16 +2,19 @@
 
 #include <roerei/dataset.hpp>
 #include <roerei/dependencies.hpp>
+#include <roerei/normalize.hpp>
 
 #include <roerei/generic/sparse_unit_matrix.hpp>
 #include <roerei/generic/wl_sparse_matrix.hpp>
 #include <roerei/generic/sparse_readonly_unit_matrix.hpp>
 
 #include <roerei/util/performance.hpp>
+#include <roerei/util/fast_log.hpp>
 
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <memory>
 
 namespace roerei
 {
@@ -31,16 +34,14 @@ struct nb_preload_data_t
 		, allowed_dependencies(d.objects.size())
 		, feature_occurance(d.features.size())
 	{
-		std::map<object_id_t, dependency_id_t> dependency_revmap(d.create_dependency_revmap());
 		dependencies::dependant_obj_matrix_t dependants_trans(dependencies::create_obj_dependants(d));
 		dependants_trans.transitive();
 
 		d.objects.keys([&](object_id_t i) {
 			std::vector<dependency_id_t> wl, bl;
 			dependants_trans.citerate(i, [&](object_id_t forbidden) {
-				auto it = dependency_revmap.find(forbidden);
-				if(it != dependency_revmap.end()) {
-					bl.emplace_back(it->second);
+				if(auto const& j = d.object_dependencies[forbidden]) {
+					bl.emplace_back(*j);
 				}
 			});
 
@@ -68,9 +69,43 @@ struct nb_preload_data_t
 	}
 };
 
-template<typename MATRIX>
+// log(pi * n) and log(n) for all n below the table size; these only depend on pi, and are shared by all queries
+template<typename LOG = default_log_t>
+struct nb_log_tables_t
+{
+	static constexpr size_t default_size = 1024;
+
+	float const pi;
+	std::vector<float> const log_pi_table, log_table;
+
+	nb_log_tables_t(nb_log_tables_t const&) = delete;
+
+	nb_log_tables_t(float _pi, size_t size = default_size)
+		: pi(_pi)
+		, log_pi_table(create(pi, size))
+		, log_table(create(1.0f, size))
+	{}
+
+	static std::vector<float> create(float factor, size_t size)
+	{
+		std::vector<float> table(size);
+		for(size_t n = 0; n < size; ++n)
+			table[n] = factor * static_cast<float>(n);
+
+		LOG::log(table.data(), table.size());
+		return table;
+	}
+};
+
+template<typename LOG>
+constexpr size_t nb_log_tables_t<LOG>::default_size;
+
+template<typename MATRIX, typename LOG = default_log_t>
 class naive_bayes
 {
+public:
+	static constexpr size_t default_log_table_size = nb_log_tables_t<LOG>::default_size;
+
 private:
 	float const pi, sigma, tau;
 
@@ -78,11 +113,21 @@ private:
 	nb_preload_data_t const& pld;
 	MATRIX const& trainingset;
 
+	std::shared_ptr<nb_log_tables_t<LOG> const> const tables;
+
 private:
 	struct rank_buffers_t {
 		std::vector<object_id_t> candidates;
 	};
 
+	static inline float lookup_log(std::vector<float> const& table, float factor, size_t n)
+	{
+		if(n < table.size())
+			return table[n];
+
+		return LOG::log(factor * static_cast<float>(n));
+	}
+
 	template<typename ROW>
 	float rank(dependency_id_t phi_id, ROW const& test_row, std::vector<object_id_t> const& whitelist, rank_buffers_t& buffers) const
 	{
@@ -105,7 +150,7 @@ private:
 			return -INFINITY;
 
 		size_t P = buffers.candidates.size() + tau;
-		float log_p = std::log(static_cast<float>(P));
+		float log_p = lookup_log(tables->log_table, 1.0f, P);
 		float result = log_p;
 
 		for(auto const& kvp_j : test_row)
@@ -116,7 +161,7 @@ private:
 			if(p_j == 0)
 				result += kvp_j.second * sigma;
 			else
-				result += kvp_j.second * (std::log(pi * static_cast<float>(p_j)) - log_p);
+				result += kvp_j.second * (lookup_log(tables->log_pi_table, pi, p_j) - log_p);
 		}
 
 		return result;
@@ -129,7 +174,8 @@ public:
 			float _tau, // default 20
 			dataset_t const& _d,
 			nb_preload_data_t const& _pld,
-			MATRIX const& _trainingset
+			MATRIX const& _trainingset,
+			size_t _log_table_size = default_log_table_size
 		)
 		: pi(_pi)
 		, sigma(_sigma)
@@ -137,10 +183,49 @@ public:
 		, d(_d)
 		, pld(_pld)
 		, trainingset(_trainingset)
+		, tables(std::make_shared<nb_log_tables_t<LOG> const>(pi, _log_table_size))
+	{}
+
+	// With the tables of pi, as built once for many instances
+	naive_bayes(
+			float _sigma,
+			float _tau,
+			dataset_t const& _d,
+			nb_preload_data_t const& _pld,
+			std::shared_ptr<nb_log_tables_t<LOG> const> const& _tables,
+			MATRIX const& _trainingset
+		)
+		: pi(_tables->pi)
+		, sigma(_sigma)
+		, tau(_tau)
+		, d(_d)
+		, pld(_pld)
+		, trainingset(_trainingset)
+		, tables(_tables)
 	{}
 
 	template<typename ROW>
 	std::vector<std::pair<dependency_id_t, float>> predict(ROW const& test_row, object_id_t test_row_id) const
+	{
+		return predict_allowed(test_row, pld.allowed_dependencies[test_row_id]);
+	}
+
+	// For a row which is not part of the dataset; every dependency is allowed
+	template<typename ROW>
+	std::vector<std::pair<dependency_id_t, float>> predict(ROW const& test_row) const
+	{
+		std::vector<dependency_id_t> allowed_dependencies;
+		allowed_dependencies.reserve(d.dependencies.size());
+		d.dependencies.keys([&](dependency_id_t phi_id) {
+			allowed_dependencies.emplace_back(phi_id);
+		});
+
+		return predict_allowed(test_row, allowed_dependencies);
+	}
+
+private:
+	template<typename ROW>
+	std::vector<std::pair<dependency_id_t, float>> predict_allowed(ROW const& test_row, std::vector<dependency_id_t> const& allowed_dependencies) const
 	{
 		std::vector<std::pair<dependency_id_t, float>> ranks;
 
@@ -172,12 +257,12 @@ public:
 		if(whitelist.empty())
 			return ranks;
 
-		ranks.reserve(pld.allowed_dependencies.size());
+		ranks.reserve(allowed_dependencies.size());
 
 		rank_buffers_t buffers;
 		buffers.candidates.reserve(d.objects.size());
 
-		for(dependency_id_t phi_id : pld.allowed_dependencies[test_row_id])
+		for(dependency_id_t phi_id : allowed_dependencies)
 		{
 			float r = rank(phi_id, test_row, whitelist, buffers);
 
@@ -193,4 +278,7 @@ public:
 	}
 };
 
+template<typename MATRIX, typename LOG>
+constexpr size_t naive_bayes<MATRIX, LOG>::default_log_table_size;
+
 }
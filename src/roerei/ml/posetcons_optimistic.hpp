@@ -4,6 +4,7 @@
 
 #include <roerei/generic/encapsulated_vector.hpp>
 #include <roerei/generic/wl_sparse_matrix.hpp>
+#include <roerei/generic/row_mask.hpp>
 
 #include <map>
 #include <set>
@@ -38,7 +39,7 @@ public:
 	template<typename TRAINSET>
 	wl_sparse_matrix_t<TRAINSET> exec(TRAINSET const& train_m, object_id_t test_row_id) const
 	{
-		return wl_sparse_matrix_t<TRAINSET>(train_m, parents_real[test_row_id]);
+		return wl_sparse_matrix_t<TRAINSET>(train_m, parents_real[test_row_id], row_mask_t<object_id_t>::local(train_m.size_m()));
 	}
 };
 
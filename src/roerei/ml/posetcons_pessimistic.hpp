@@ -4,6 +4,7 @@
 
 #include <roerei/generic/encapsulated_vector.hpp>
 #include <roerei/generic/bl_sparse_matrix.hpp>
+#include <roerei/generic/row_mask.hpp>
 
 #include <map>
 #include <set>
@@ -18,8 +19,7 @@ private:
 
 	static decltype(dependants_real) generate_dependants(dataset_t const& d)
 	{
-		std::map<dependency_id_t, object_id_t> dependency_map(d.create_dependency_map());
-		dependencies::dependant_obj_matrix_t dependants_trans(dependencies::create_obj_dependants(d, dependency_map));
+		dependencies::dependant_obj_matrix_t dependants_trans(dependencies::create_obj_dependants(d));
 		dependants_trans.transitive();
 
 		decltype(dependants_real) dependants_real(dependants_trans.size_m());
@@ -39,7 +39,7 @@ public:
 	template<typename TRAINSET>
 	bl_sparse_matrix_t<TRAINSET> exec(TRAINSET const& train_m, object_id_t test_row_i) const
 	{
-		return bl_sparse_matrix_t<TRAINSET>(train_m, dependants_real[test_row_i]);
+		return bl_sparse_matrix_t<TRAINSET>(train_m, dependants_real[test_row_i], row_mask_t<object_id_t>::local(train_m.size_m()));
 	}
 };
 
@@ -0,0 +1,129 @@
+#include <roerei/cpp14_fix.hpp>
+
+#include <roerei/perf_reporter.hpp>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace roerei
+{
+	struct jobset_summary_t
+	{
+		std::string name;
+		size_t folds = 0, train_rows = 0, test_rows = 0;
+		double duration = 0.0, test_duration = 0.0, max_fold_duration = 0.0;
+		long peak_rss_kb = 0;
+	};
+
+	struct scope_summary_t
+	{
+		std::string scope;
+		uint64_t count, total_ns;
+	};
+
+	void perf_reporter::exec(std::string const& events_path)
+	{
+		std::ifstream is(events_path);
+		if(!is)
+			throw std::runtime_error("Could not open event stream " + events_path);
+
+		std::map<size_t, jobset_summary_t> jobsets;
+		std::vector<scope_summary_t> scopes;
+		double wall_time = 0.0;
+		long peak_rss_kb = 0;
+
+		std::string line;
+		size_t line_i = 0;
+		while(std::getline(is, line))
+		{
+			line_i++;
+			if(line.empty())
+				continue;
+
+			// Malformed events, or events without the expected fields, are skipped as a whole
+			try
+			{
+				boost::property_tree::ptree e;
+				std::stringstream ss(line);
+				boost::property_tree::read_json(ss, e);
+
+				std::string const type = e.get<std::string>("event", "");
+				double const time = e.get<double>("time", 0.0);
+				long const rss_kb = e.get<long>("peak_rss_kb", 0);
+
+				if(type == "jobset")
+				{
+					size_t const jobset = e.get<size_t>("jobset");
+					jobsets[jobset].name = e.get<std::string>("name", "");
+				}
+				else if(type == "fold")
+				{
+					size_t const jobset = e.get<size_t>("jobset");
+					double const duration = e.get<double>("duration");
+					size_t const train_rows = e.get<size_t>("train_rows");
+					size_t const test_rows = e.get<size_t>("test_rows");
+					double const test_duration = e.get<double>("test_duration");
+
+					auto& j = jobsets[jobset];
+					j.folds++;
+					j.train_rows += train_rows;
+					j.test_rows += test_rows;
+					j.duration += duration;
+					j.test_duration += test_duration;
+					j.max_fold_duration = std::max(j.max_fold_duration, duration);
+					j.peak_rss_kb = std::max(j.peak_rss_kb, rss_kb);
+				}
+				else if(type == "profile")
+					scopes.push_back({e.get<std::string>("scope"), e.get<uint64_t>("count"), e.get<uint64_t>("total_ns")});
+
+				wall_time = std::max(wall_time, time);
+				peak_rss_kb = std::max(peak_rss_kb, rss_kb);
+			} catch(boost::property_tree::ptree_error const&)
+			{
+				std::cerr << "Skipping malformed event on line " << line_i << std::endl;
+			}
+		}
+
+		auto rows_per_sec = [](size_t rows, double duration) {
+			return duration > 0.0 ? rows / duration : 0.0;
+		};
+
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "wall time: " << wall_time << "s, peak RSS: " << peak_rss_kb << "kB" << std::endl;
+
+		size_t total_test_rows = 0;
+		double total_test_duration = 0.0;
+
+		std::cout << std::endl << "jobset\tfolds\ttest rows\tfold time (s)\tmax fold (s)\trows/s\tpeak RSS (kB)\tname" << std::endl;
+		for(auto const& kvp : jobsets)
+		{
+			auto const& j = kvp.second;
+			std::cout << kvp.first << '\t' << j.folds << '\t' << j.test_rows << '\t' << j.duration << '\t' << j.max_fold_duration
+				<< '\t' << rows_per_sec(j.test_rows, j.test_duration) << '\t' << j.peak_rss_kb << '\t' << j.name << std::endl;
+
+			total_test_rows += j.test_rows;
+			total_test_duration += j.test_duration;
+		}
+		std::cout << "total\t\t" << total_test_rows << "\t\t\t" << rows_per_sec(total_test_rows, total_test_duration) << std::endl;
+
+		if(scopes.empty())
+			return;
+
+		std::sort(scopes.begin(), scopes.end(), [](scope_summary_t const& x, scope_summary_t const& y) {
+			return x.total_ns > y.total_ns;
+		});
+
+		std::cout << std::endl << "total (ms)\tcount\tmean (µs)\tscope" << std::endl;
+		for(auto const& s : scopes)
+			std::cout << s.total_ns / 1e6 << '\t' << s.count << '\t' << (s.count > 0 ? s.total_ns / 1e3 / s.count : 0.0) << '\t' << s.scope << std::endl;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+namespace roerei
+{
+	class perf_reporter
+	{
+	public:
+		// Summarizes the throughput of the jobsets and the profiler counters of an event stream
+		static void exec(std::string const& events_path);
+	};
+}
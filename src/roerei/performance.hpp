@@ -3,6 +3,7 @@
 #include <roerei/dataset.hpp>
 
 #include <roerei/generic/math.hpp>
+#include <roerei/generic/quantile_sketch.hpp>
 
 #include <roerei/util/performance.hpp>
 
@@ -98,6 +99,82 @@ public:
 		}
 	};
 
+	/* Sums of the metrics of individual test rows, weighted by their n. Adding and merging only
+	 * sums, so unlike repeatedly adding metrics_t no rounding error is accumulated. Also keeps
+	 * the distribution of rank and recall.
+	 */
+	struct metrics_accumulator_t
+	{
+		double oocover, cover, ooprecision, recall, rank, auc, volume;
+		size_t n;
+
+		quantile_sketch_t rank_sketch, recall_sketch;
+
+		metrics_accumulator_t()
+			: oocover(0.0)
+			, cover(0.0)
+			, ooprecision(0.0)
+			, recall(0.0)
+			, rank(0.0)
+			, auc(0.0)
+			, volume(0.0)
+			, n(0)
+			, rank_sketch()
+			, recall_sketch()
+		{}
+
+		metrics_accumulator_t& operator+=(metrics_t const& rhs)
+		{
+			double const w = rhs.n;
+			oocover += w * rhs.oocover;
+			cover += w * rhs.cover;
+			ooprecision += w * rhs.ooprecision;
+			recall += w * rhs.recall;
+			rank += w * rhs.rank;
+			auc += w * rhs.auc;
+			volume += w * rhs.volume;
+			n += rhs.n;
+
+			rank_sketch.add(rhs.rank, rhs.n);
+			recall_sketch.add(rhs.recall, rhs.n);
+			return *this;
+		}
+
+		metrics_accumulator_t& operator+=(metrics_accumulator_t const& rhs)
+		{
+			oocover += rhs.oocover;
+			cover += rhs.cover;
+			ooprecision += rhs.ooprecision;
+			recall += rhs.recall;
+			rank += rhs.rank;
+			auc += rhs.auc;
+			volume += rhs.volume;
+			n += rhs.n;
+
+			rank_sketch += rhs.rank_sketch;
+			recall_sketch += rhs.recall_sketch;
+			return *this;
+		}
+
+		metrics_t metrics() const
+		{
+			if(n == 0)
+				return metrics_t();
+
+			double const total = n;
+			return {
+				static_cast<float>(oocover / total),
+				static_cast<float>(cover / total),
+				static_cast<float>(ooprecision / total),
+				static_cast<float>(recall / total),
+				static_cast<float>(rank / total),
+				static_cast<float>(auc / total),
+				static_cast<float>(volume / total),
+				n
+			};
+		}
+	};
+
 	struct result_t
 	{
 		metrics_t metrics;
@@ -138,38 +215,34 @@ public:
 		return std::make_pair(recall, rank);
 	}
 
-	static float compute_auc(float c_required, std::vector<dependency_id_t> const& found_deps, std::vector<dependency_id_t> const& irrelevant_deps, std::map<dependency_id_t, size_t> const& suggestions_ranks)
+	/* Probability that a found dependency is ranked before an irrelevant one (Mann-Whitney U).
+	 * Counts the irrelevant suggestions below each found dependency in a single pass from the bottom.
+	 * found_deps must be sorted.
+	 */
+	static float compute_auc(float c_required, std::vector<dependency_id_t> const& found_deps, std::vector<std::pair<dependency_id_t, float>> const& suggestions_sorted)
 	{
-		// TODO this can be computed much faster with moving iterators
-
 		performance_scope("auc")
-		auto sr_f([&](dependency_id_t i) -> size_t { return suggestions_ranks.find(i)->second; }); // Cannot be std::map::end
 
 		if(c_required == 0)
 			return 1.0f;
 
-		if(irrelevant_deps.empty())
+		if(found_deps.size() == suggestions_sorted.size()) // No irrelevant suggestions
 			return 1.0f;
 
 		if(found_deps.empty())
 			return 0.0f;
 
-		std::vector<size_t> found_ranks, irrelevant_ranks;
-		found_ranks.reserve(found_deps.size());
-		for(dependency_id_t i : found_deps)
-			found_ranks.emplace_back(sr_f(i));
-
-		irrelevant_ranks.reserve(irrelevant_deps.size());
-		for(dependency_id_t j : irrelevant_deps)
-			irrelevant_ranks.emplace_back(sr_f(j));
-
-		float auc_sum = 0.0f;
-		for(size_t x : found_ranks)
-			for(size_t y : irrelevant_ranks)
-				if(x < y) // Lower rank is 'better'
-					auc_sum += 1.0f;
+		size_t irrelevant_below = 0;
+		size_t auc_sum = 0;
+		for(auto it = suggestions_sorted.rbegin(); it != suggestions_sorted.rend(); ++it)
+		{
+			if(std::binary_search(found_deps.begin(), found_deps.end(), it->first))
+				auc_sum += irrelevant_below;
+			else
+				irrelevant_below++;
+		}
 
-		return auc_sum / static_cast<float>(found_deps.size() * irrelevant_deps.size());
+		return static_cast<float>(auc_sum) / static_cast<float>(found_deps.size() * irrelevant_below);
 	}
 
 	static void sort(std::vector<std::pair<dependency_id_t, float>>& suggestions) noexcept
@@ -241,17 +314,148 @@ public:
 		return oocover;
 	}
 
+	struct measure_buffer_t {
+		std::vector<bool> required_mask;
+		std::vector<dependency_id_t> required_deps;
+		std::vector<std::pair<float, size_t>> found; // Score and index in the suggestions
+		std::vector<size_t> found_ranks;
+
+		measure_buffer_t(dataset_t const& d)
+		: required_mask(d.dependencies.size(), false)
+		, required_deps()
+		, found()
+		, found_ranks()
+		{
+			required_deps.reserve(d.dependencies.size());
+			found.reserve(d.dependencies.size());
+			found_ranks.reserve(d.dependencies.size() + 1);
+		}
+	};
+
+	/* Computes the same metrics as measure, without sorting the suggestions.
+	 * Only the ranks of the required dependencies are determined, by counting the suggestions
+	 * that precede them. Suggestions with equal scores are ranked in order of appearance.
+	 */
+	static metrics_t measure_metrics(dataset_t const& d, object_id_t test_row_i, std::vector<std::pair<dependency_id_t, float>> const& suggestions, measure_buffer_t& buffer) noexcept
+	{
+		performance_scope("measure_metrics")
+
+		auto const precedes([](std::pair<float, size_t> const& x, std::pair<float, size_t> const& y) {
+			return x.first > y.first || (x.first == y.first && x.second < y.second);
+		});
+
+		buffer.required_deps.clear();
+		buffer.found.clear();
+		buffer.found_ranks.clear();
+
+		for(auto const& kvp : d.dependency_matrix[test_row_i])
+		{
+			buffer.required_deps.emplace_back(kvp.first);
+			buffer.required_mask[kvp.first.unseal()] = true;
+		}
+
+		for(size_t j = 0; j < suggestions.size(); ++j)
+			if(buffer.required_mask[suggestions[j].first.unseal()])
+				buffer.found.emplace_back(suggestions[j].second, j);
+
+		for(dependency_id_t i : buffer.required_deps)
+			buffer.required_mask[i.unseal()] = false;
+
+		std::sort(buffer.found.begin(), buffer.found.end(), precedes);
+
+		// found_ranks[k+1] - found_ranks[k] is the number of suggestions ranked between found[k-1] and found[k]
+		buffer.found_ranks.resize(buffer.found.size() + 1, 0);
+		if(!buffer.found.empty())
+			for(size_t j = 0; j < suggestions.size(); ++j)
+			{
+				auto it = std::upper_bound(buffer.found.begin(), buffer.found.end(), std::make_pair(suggestions[j].second, j), precedes);
+				buffer.found_ranks[std::distance(buffer.found.begin(), it)]++;
+			}
+
+		for(size_t k = 1; k < buffer.found_ranks.size(); ++k)
+			buffer.found_ranks[k] += buffer.found_ranks[k-1];
+
+		// Rank of found[k] is found_ranks[k]
+		size_t c_oofound_i = 0;
+		size_t auc_sum_i = 0;
+		float rank = 0.0f;
+		for(size_t k = 0; k < buffer.found.size(); ++k)
+		{
+			size_t const r = buffer.found_ranks[k];
+			if(r < 100)
+				c_oofound_i++;
+
+			rank += r;
+			auc_sum_i += suggestions.size() - r - (buffer.found.size() - k); // Irrelevant suggestions ranked lower
+		}
+
+		float c_required = buffer.required_deps.size();
+		float c_found = buffer.found.size();
+		float c_suggested = suggestions.size();
+		float c_oosuggested = std::min<size_t>(suggestions.size(), 100);
+		float c_oofound = c_oofound_i;
+		float c_total = d.dependencies.size();
+
+		float oocover = c_oofound/c_required;
+		float cover = c_found/c_required;
+		float ooprecision = c_oofound/c_oosuggested;
+
+		if(c_oofound == 0.0f)
+			ooprecision = 0.0f;
+
+		if(c_required == 0.0f)
+		{
+			oocover = 1.0f;
+			cover = 1.0f;
+			ooprecision = 1.0f;
+		}
+
+		// See compute_recall_rank
+		float recall = c_suggested + 1.0f;
+		if(c_required == 0.0f)
+		{
+			recall = 0.0f;
+			rank = 0.0f;
+		}
+		else
+		{
+			if(c_found == c_required)
+				recall = buffer.found_ranks[buffer.found.size()-1] + 1;
+
+			if(c_found > 0.0f)
+				rank /= c_found;
+			else
+				rank = c_suggested + 1.0f;
+		}
+
+		// See compute_auc
+		float auc;
+		size_t const c_irrelevant = suggestions.size() - buffer.found.size();
+		if(c_required == 0.0f || c_irrelevant == 0)
+			auc = 1.0f;
+		else if(buffer.found.empty())
+			auc = 0.0f;
+		else
+			auc = static_cast<float>(auc_sum_i) / static_cast<float>(buffer.found.size() * c_irrelevant);
+
+		return {
+			oocover,
+			cover,
+			ooprecision,
+			recall,
+			rank,
+			auc,
+			c_suggested / c_total
+		};
+	}
+
 	static result_t measure(dataset_t const& d, object_id_t test_row_i, std::vector<std::pair<dependency_id_t, float>> suggestions) noexcept
 	{
 		performance_scope("measure_analyze")
 
 		performance::sort(suggestions);
 
-		std::map<dependency_id_t, size_t> suggestions_ranks;
-		for(size_t j = 0; j < suggestions.size(); ++j)
-			suggestions_ranks[suggestions[j].first] = j;
-
-		std::vector<dependency_id_t> required_deps, suggested_deps, oosuggested_deps, found_deps, oofound_deps, missing_deps, irrelevant_deps;
+		std::vector<dependency_id_t> required_deps, suggested_deps, oosuggested_deps, found_deps, oofound_deps, missing_deps;
 		for(auto const& kvp : d.dependency_matrix[test_row_i])
 			required_deps.emplace_back(kvp.first);
 
@@ -282,12 +486,6 @@ public:
 			std::inserter(found_deps, found_deps.begin())
 		);
 
-		std::set_difference(
-			suggested_deps.begin(), suggested_deps.end(),
-			found_deps.begin(), found_deps.end(),
-			std::inserter(irrelevant_deps, irrelevant_deps.begin())
-		);
-
 		float c_required = required_deps.size();
 		float c_found = found_deps.size();
 		float c_suggested = suggested_deps.size();
@@ -318,7 +516,7 @@ public:
 				ooprecision,
 				recall_rank_kvp.first,
 				recall_rank_kvp.second,
-				compute_auc(c_required, found_deps, irrelevant_deps, suggestions_ranks),
+				compute_auc(c_required, found_deps, suggestions),
 				c_suggested / c_total
 			},
 			std::move(suggestions),
@@ -342,6 +540,22 @@ inline std::ostream& operator<<(std::ostream& os, roerei::performance::metrics_t
 	return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, roerei::performance::metrics_accumulator_t const& rhs)
+{
+	auto const quantiles_f([&](quantile_sketch_t const& sketch) {
+		os
+			<< "p50 " << roerei::fill(roerei::round(sketch.quantile(0.5), 1), 4) << ' '
+			<< "p90 " << roerei::fill(roerei::round(sketch.quantile(0.9), 1), 4) << ' '
+			<< "p99 " << roerei::fill(roerei::round(sketch.quantile(0.99), 1), 4);
+	});
+
+	os << rhs.metrics() << " + FullRecall ";
+	quantiles_f(rhs.recall_sketch);
+	os << " + Rank ";
+	quantiles_f(rhs.rank_sketch);
+	return os;
+}
+
 }
 
 BOOST_FUSION_ADAPT_STRUCT(
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <roerei/cv_result.hpp>
+
+#include <roerei/serialization/serialize_fusion.hpp>
+#include <roerei/serialization/deserialize_fusion.hpp>
+#include <roerei/serialization/msgpack_serializer.hpp>
+#include <roerei/serialization/msgpack_deserializer.hpp>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace roerei
+{
+
+// The key by which results of type T are indexed, and the name under which they are serialized
+template<typename T>
+struct results_traits;
+
+template<>
+struct results_traits<cv_result_t>
+{
+	typedef std::tuple<std::string, bool, posetcons_type, ml_type, boost::optional<knn_params_t>, boost::optional<nb_params_t>, boost::optional<adarank_params_t>, size_t, size_t> key_t;
+
+	static key_t key(cv_result_t const& r)
+	{
+		return key_t(r.corpus, r.prior, r.strat, r.ml, r.knn_params, r.nb_params, r.adarank_params, r.n, r.k);
+	}
+
+	static std::string name()
+	{
+		return "cv_result_v2";
+	}
+};
+
+template<>
+struct results_traits<cv_fold_result_t>
+{
+	typedef std::tuple<results_traits<cv_result_t>::key_t, uint64_t, uint64_t, size_t> key_t;
+
+	static key_t key(cv_fold_result_t const& r)
+	{
+		return key_t(results_traits<cv_result_t>::key(r.result), r.seed, r.fingerprint, r.fold);
+	}
+
+	static std::string name()
+	{
+		return "cv_fold_result";
+	}
+};
+
+/* The results in a file, read once and indexed in memory by their key.
+ *
+ * The file is a sequence of msgpack bin values, which each hold a single serialized result; thus every
+ * record is prefixed with its length. A torn record at the end, as left by a crash, is ignored and truncated
+ * before the next append. Files of bare results, as written before, can still be read; they are rewritten as
+ * records before the first append.
+ *
+ * Appended results are written in batches by a single writer thread, which syncs the file after every batch
+ * when sync is set. After results are erased, the file is replaced at once by the remaining results.
+ */
+template<typename T>
+class basic_results_store
+{
+public:
+	typedef typename results_traits<T>::key_t key_t;
+
+	static key_t key(T const& r)
+	{
+		return results_traits<T>::key(r);
+	}
+
+private:
+	std::string const path;
+	bool const sync;
+
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<T> results; // In the order of the file
+	std::map<key_t, size_t> index; // The last result of each key
+
+	bool rewrite; // Whether the file is replaced by the results before the next append
+	size_t valid_size; // Of the file, up to the last complete record
+	std::vector<std::string> queue;
+	size_t queued, written; // Additions and erasures
+	std::exception_ptr error;
+	bool done;
+	std::thread writer;
+
+	static bool is_record(char c)
+	{
+		uint8_t const x = static_cast<uint8_t>(c);
+		return x == 0xc4 || x == 0xc5 || x == 0xc6; // bin 8, 16 and 32
+	}
+
+	// Reads the record at p, and moves p past it; returns false if the record is incomplete
+	static bool read_record(std::string const& buf, size_t& p, std::pair<char const*, size_t>& body)
+	{
+		if(!is_record(buf[p]))
+			throw std::runtime_error("Not a results record");
+
+		size_t const width = static_cast<size_t>(1) << (static_cast<uint8_t>(buf[p]) - 0xc4);
+		if(buf.size() - p < 1 + width)
+			return false;
+
+		size_t len = 0;
+		for(size_t i = 0; i < width; ++i)
+			len = (len << 8) | static_cast<uint8_t>(buf[p + 1 + i]);
+
+		if(buf.size() - p - 1 - width < len)
+			return false;
+
+		body = std::make_pair(buf.data() + p + 1 + width, len);
+		p += 1 + width + len;
+		return true;
+	}
+
+	static std::string encode(T const& r)
+	{
+		std::string const name(results_traits<T>::name());
+		std::string body, record;
+		msgpack_serializer s;
+		serialize(s, name, r);
+		s.dump([&](char const* buf, size_t len) {
+			body.append(buf, len);
+		});
+
+		msgpack_serializer s_record;
+		s_record.write_bin(name, body);
+		s_record.dump([&](char const* buf, size_t len) {
+			record.append(buf, len);
+		});
+		return record;
+	}
+
+	void emplace(T&& r) /* Thread unsafe */
+	{
+		index[key(r)] = results.size();
+		results.emplace_back(std::move(r));
+	}
+
+	void load()
+	{
+		std::string const name(results_traits<T>::name());
+		std::ifstream is(path, std::ios::binary);
+		std::string const buf((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+		rewrite = !buf.empty() && !is_record(buf[0]);
+		if(rewrite)
+		{
+			msgpack_deserializer d;
+			d.feed(buf);
+			try
+			{
+				while(true)
+					emplace(deserialize<T>(d, name));
+			} catch(eob_error const&)
+			{
+				// Done
+			}
+
+			return;
+		}
+
+		size_t p = 0;
+		std::pair<char const*, size_t> body;
+		while(p < buf.size() && read_record(buf, p, body))
+		{
+			msgpack_deserializer d;
+			d.feed(std::string(body.first, body.second));
+			emplace(deserialize<T>(d, name));
+		}
+		valid_size = p;
+	}
+
+	static void write_all(int fd, std::string const& buf)
+	{
+		for(size_t p = 0; p < buf.size();)
+		{
+			ssize_t const n = ::write(fd, buf.data() + p, buf.size() - p);
+			if(n < 0 && errno != EINTR)
+				throw std::runtime_error("Could not write results: " + std::string(std::strerror(errno)));
+			if(n > 0)
+				p += n;
+		}
+	}
+
+	// Makes the file consist of the complete records only, before appending to it
+	void prepare(int& fd) /* Writer thread */
+	{
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if(fd < 0)
+			throw std::runtime_error("Could not open results " + path);
+
+		if(::ftruncate(fd, valid_size) != 0)
+		{
+			::close(fd);
+			fd = -1;
+			throw std::runtime_error("Could not truncate results " + path);
+		}
+	}
+
+	// Replaces the file at once by the records of snapshot, and reopens it to append to it
+	void replace(int& fd, std::vector<T> const& snapshot) /* Writer thread */
+	{
+		std::string buf;
+		for(auto const& r : snapshot)
+			buf += encode(r);
+
+		std::string const tmp_path = path + ".tmp";
+		int const tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(tmp_fd < 0)
+			throw std::runtime_error("Could not open results " + tmp_path);
+
+		try
+		{
+			write_all(tmp_fd, buf);
+		} catch(...)
+		{
+			::close(tmp_fd);
+			throw;
+		}
+
+		bool const synced = ::fsync(tmp_fd) == 0;
+		::close(tmp_fd);
+		if(!synced || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+			throw std::runtime_error("Could not replace results " + path);
+
+		// Make the rename itself durable
+		auto const slash = path.rfind('/');
+		int const dir_fd = ::open(slash == std::string::npos ? "." : path.substr(0, slash + 1).c_str(), O_RDONLY);
+		if(dir_fd >= 0)
+		{
+			::fsync(dir_fd);
+			::close(dir_fd);
+		}
+
+		if(fd >= 0)
+			::close(fd);
+
+		fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+		if(fd < 0)
+			throw std::runtime_error("Could not open results " + path);
+	}
+
+	void run()
+	{
+		int fd = -1;
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true)
+		{
+			cv.wait(lock, [&]() { return done || rewrite || !queue.empty(); });
+			if(!rewrite && queue.empty())
+				break; // Done
+
+			size_t const upto = queued;
+			std::vector<std::string> batch;
+			batch.swap(queue);
+
+			// The results in memory include those of the batch
+			bool const replace_f = rewrite;
+			std::vector<T> snapshot;
+			if(replace_f)
+				snapshot = results;
+			rewrite = false;
+
+			lock.unlock();
+			try
+			{
+				if(replace_f)
+					replace(fd, snapshot);
+				else
+				{
+					if(fd < 0)
+						prepare(fd);
+
+					std::string buf;
+					for(auto const& record : batch)
+						buf += record;
+
+					write_all(fd, buf);
+					if(sync && ::fsync(fd) != 0)
+						throw std::runtime_error("Could not sync results " + path);
+				}
+			} catch(...)
+			{
+				lock.lock();
+				error = std::current_exception();
+				written = queued;
+				cv.notify_all();
+				break;
+			}
+			lock.lock();
+
+			written = upto;
+			cv.notify_all();
+		}
+
+		if(fd >= 0)
+			::close(fd);
+	}
+
+	void rethrow() /* Thread unsafe */
+	{
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+public:
+	basic_results_store(std::string const& _path, bool _sync = true)
+		: path(_path)
+		, sync(_sync)
+		, mutex()
+		, cv()
+		, results()
+		, index()
+		, rewrite(false)
+		, valid_size(0)
+		, queue()
+		, queued(0)
+		, written(0)
+		, error()
+		, done(false)
+		, writer()
+	{
+		load();
+	}
+
+	basic_results_store(basic_results_store const&) = delete;
+
+	~basic_results_store()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+
+		if(writer.joinable())
+			writer.join();
+	}
+
+	boost::optional<T> find(key_t const& k) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(k);
+		if(it == index.end())
+			return boost::none;
+
+		return results[it->second];
+	}
+
+	bool contains(key_t const& k) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return index.find(k) != index.end();
+	}
+
+	// All results in the order in which they were added, including repeated keys
+	template<typename F>
+	void iterate(F const& f) const
+	{
+		std::vector<T> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			snapshot = results;
+		}
+
+		for(auto const& r : snapshot)
+			f(r);
+	}
+
+	// Thread safe; the result is written in the background (see flush)
+	void add(T const& r)
+	{
+		std::string record(encode(r));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rethrow();
+
+			emplace(T(r));
+			queue.emplace_back(std::move(record));
+			queued++;
+
+			if(!writer.joinable())
+				writer = std::thread([this]() { run(); });
+		}
+		cv.notify_all();
+	}
+
+	// Thread safe; the file is replaced in the background (see flush)
+	template<typename F>
+	void erase_if(F const& f)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rethrow();
+
+			auto const it = std::remove_if(results.begin(), results.end(), f);
+			if(it == results.end())
+				return;
+
+			results.erase(it, results.end());
+			index.clear();
+			for(size_t i = 0; i < results.size(); ++i)
+				index[key(results[i])] = i;
+
+			rewrite = true;
+			queued++;
+
+			if(!writer.joinable())
+				writer = std::thread([this]() { run(); });
+		}
+		cv.notify_all();
+	}
+
+	// Waits until all added and erased results have been written, and rethrows a failure to write them
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&]() { return written == queued; });
+		rethrow();
+	}
+};
+
+typedef basic_results_store<cv_result_t> results_store;
+typedef basic_results_store<cv_fold_result_t> fold_results_store;
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace roerei
+{
+
+/* Fixed width little endian encoding of unsigned integers, for the binary blobs of bulk serialization.
+ * A blob is a plain array of such integers, independent of the byte order of the host.
+ */
+class binary
+{
+	binary() = delete;
+
+public:
+	template<typename U>
+	static inline void append(std::string& buf, U x)
+	{
+		static_assert(std::is_unsigned<U>::value, "Only unsigned integers can be encoded");
+
+		char bytes[sizeof(U)];
+		for(std::size_t i = 0; i < sizeof(U); ++i)
+			bytes[i] = static_cast<char>(static_cast<uint8_t>(x >> (8 * i)));
+
+		buf.append(bytes, sizeof(U));
+	}
+
+	template<typename U>
+	static inline U read(char const* p)
+	{
+		static_assert(std::is_unsigned<U>::value, "Only unsigned integers can be decoded");
+
+		U x = 0;
+		for(std::size_t i = 0; i < sizeof(U); ++i)
+			x |= static_cast<U>(static_cast<uint8_t>(p[i])) << (8 * i);
+
+		return x;
+	}
+
+	// The number of integers of type U in a blob of len bytes
+	template<typename U>
+	static inline std::size_t count(std::size_t len)
+	{
+		if(len % sizeof(U) != 0)
+			throw std::runtime_error("Inconsistency");
+
+		return len / sizeof(U);
+	}
+};
+
+}
@@ -4,6 +4,7 @@
 
 #include <msgpack.hpp>
 #include <stack>
+#include <utility>
 
 namespace roerei
 {
@@ -31,6 +32,9 @@ public:
 	void read(const std::string& key, float& x);
 	void read(const std::string& key, bool& x);
 
+	// The bytes of a binary blob, which remain valid until the next top-level object is read
+	std::pair<const char*, size_t> read_bin(const std::string& key);
+
 	void feed(const std::string& str);
 
 private:
@@ -263,4 +267,13 @@ inline void msgpack_deserializer::read(const std::string& key, bool& x)
 	});
 }
 
+inline std::pair<const char*, size_t> msgpack_deserializer::read_bin(const std::string& key)
+{
+	return autorollbackonfailure<std::pair<const char*, size_t>>(stack, [&]() {
+		read_key(key);
+		const msgpack::object& obj = read(msgpack::type::BIN);
+		return std::make_pair(obj.via.bin.ptr, static_cast<size_t>(obj.via.bin.size));
+	});
+}
+
 }
@@ -23,6 +23,7 @@ public:
 	void write(const std::string& key, const std::string& x);
 	void write(const std::string& key, const float x);
 	void write(const std::string& key, const bool x);
+	void write_bin(const std::string& key, const std::string& x);
 
 	virtual void dump(std::function<void(const char*, size_t)> f);
 	virtual void clear();
@@ -149,6 +150,13 @@ inline void msgpack_serializer::write(const std::string& key, const bool x)
 	}
 }
 
+inline void msgpack_serializer::write_bin(const std::string& key, const std::string& x)
+{
+	add_node(type_t::non_container, key, 0);
+	pk.pack_bin(x.size());
+	pk.pack_bin_body(x.data(), x.size());
+}
+
 inline void msgpack_serializer::dump(std::function<void(const char*, size_t)> f)
 {
 	f(buffer.data(), buffer.size());
@@ -0,0 +1,225 @@
+#include <roerei/cpp14_fix.hpp>
+
+#include <roerei/server.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace roerei
+{
+	/* Unbuffered writes and buffered reads on a socket. When the peer is gone, writing does not raise
+	 * SIGPIPE but fails, and shuts the socket down, such that reading ends as well.
+	 */
+	class fd_streambuf_t : public std::streambuf
+	{
+	private:
+		int const fd;
+		char buf[4096];
+
+	protected:
+		int_type underflow() override
+		{
+			ssize_t n;
+			do
+			{
+				n = ::read(fd, buf, sizeof(buf));
+			} while(n < 0 && errno == EINTR);
+
+			if(n <= 0)
+				return traits_type::eof();
+
+			setg(buf, buf, buf + n);
+			return traits_type::to_int_type(buf[0]);
+		}
+
+		std::streamsize xsputn(char const* s, std::streamsize count) override
+		{
+			std::streamsize written = 0;
+			while(written < count)
+			{
+				ssize_t n = ::send(fd, s + written, count - written, MSG_NOSIGNAL);
+				if(n < 0 && errno == EINTR)
+					continue;
+				if(n < 0 && (errno == EPIPE || errno == ECONNRESET))
+					::shutdown(fd, SHUT_RDWR);
+				if(n <= 0)
+					break;
+				written += n;
+			}
+			return written;
+		}
+
+		int_type overflow(int_type c) override
+		{
+			if(traits_type::eq_int_type(c, traits_type::eof()))
+				return traits_type::not_eof(c);
+
+			char const x = traits_type::to_char_type(c);
+			return xsputn(&x, 1) == 1 ? c : traits_type::eof();
+		}
+
+	public:
+		fd_streambuf_t(int _fd)
+			: fd(_fd)
+		{}
+	};
+
+	void server::serve(std::istream& is, std::ostream& os)
+	{
+		// Responses are written in order of request by a separate thread, such that requests can be pipelined
+		std::mutex pending_mutex;
+		std::condition_variable pending_cv;
+		std::deque<std::future<std::string>> pending;
+		bool eof = false;
+
+		std::thread writer([&]() {
+			std::unique_lock<std::mutex> lock(pending_mutex);
+			while(true)
+			{
+				pending_cv.wait(lock, [&]() { return eof || !pending.empty(); });
+				if(pending.empty())
+					return; // End of input
+
+				auto f(std::move(pending.front()));
+				pending.pop_front();
+
+				lock.unlock();
+				std::string const response(f.get());
+				if(os) // Otherwise the client is gone; its remaining requests are still answered, but dropped
+					os << response << std::endl;
+				lock.lock();
+			}
+		});
+
+		std::string line;
+		while(std::getline(is, line))
+		{
+			if(line.empty())
+				continue;
+
+			auto f(submit(line));
+			{
+				std::lock_guard<std::mutex> lock(pending_mutex);
+				pending.emplace_back(std::move(f));
+			}
+			pending_cv.notify_one();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex);
+			eof = true;
+		}
+		pending_cv.notify_one();
+		writer.join();
+	}
+
+	void server::serve_socket(std::string const& path)
+	{
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(path.size() >= sizeof(addr.sun_path))
+			throw std::runtime_error("Socket path too long: " + path);
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+		int const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+
+		::unlink(path.c_str()); // Left behind by a previous server
+		if(::bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+		{
+			std::string const error(std::strerror(errno));
+			::close(fd);
+			throw std::runtime_error("Could not listen on " + path + ": " + error);
+		}
+
+		std::cerr << "Listening on " << path << std::endl;
+
+		// Clients are ended and joined before returning, as they use this server
+		struct clients_guard_t
+		{
+			server& s;
+			int const fd;
+
+			~clients_guard_t()
+			{
+				::close(fd);
+
+				std::unique_lock<std::mutex> lock(s.clients_mutex);
+				for(int client : s.clients)
+					::shutdown(client, SHUT_RDWR);
+				s.clients_cv.wait(lock, [&]() { return s.clients.empty(); });
+			}
+		} guard{*this, fd};
+
+		// Backoff when out of descriptors or memory, until clients are done
+		std::chrono::milliseconds const max_backoff(1000);
+		std::chrono::milliseconds backoff(0);
+		auto const wait_f = [&]() {
+			backoff = std::min(max_backoff, std::max(std::chrono::milliseconds(10), backoff * 2));
+			std::this_thread::sleep_for(backoff);
+		};
+
+		while(true)
+		{
+			int const client = ::accept(fd, nullptr, nullptr);
+			if(client < 0)
+			{
+				if(errno == EINTR || errno == ECONNABORTED)
+					continue;
+
+				if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+				{
+					std::cerr << "Could not accept on " << path << ": " << std::strerror(errno) << ", retrying" << std::endl;
+					wait_f();
+					continue;
+				}
+
+				throw std::runtime_error("Could not accept on " + path + ": " + std::string(std::strerror(errno)));
+			}
+			backoff = std::chrono::milliseconds(0);
+
+			{
+				std::lock_guard<std::mutex> lock(clients_mutex);
+				clients.emplace(client);
+			}
+
+			try
+			{
+				std::thread([this, client]() {
+					{
+						fd_streambuf_t in(client), out(client);
+						std::istream is(&in);
+						std::ostream os(&out);
+						serve(is, os);
+					}
+
+					std::lock_guard<std::mutex> lock(clients_mutex);
+					::close(client);
+					clients.erase(client);
+					clients_cv.notify_all();
+				}).detach();
+			} catch(std::system_error const& e)
+			{
+				std::cerr << "Could not serve client: " << e.what() << ", retrying" << std::endl;
+				{
+					std::lock_guard<std::mutex> lock(clients_mutex);
+					::close(client);
+					clients.erase(client);
+				}
+				wait_f();
+			}
+		}
+	}
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <roerei/dataset.hpp>
+
+#include <roerei/generic/compact_sparse_matrix.hpp>
+#include <roerei/generic/quantile_sketch.hpp>
+
+#include <roerei/ml/ml_type.hpp>
+#include <roerei/ml/knn.hpp>
+#include <roerei/ml/knn_adaptive.hpp>
+#include <roerei/ml/naive_bayes.hpp>
+#include <roerei/ml/posetcons_canonical.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace roerei
+{
+
+/* Answers premise selection queries over a dataset which is loaded and prepared once.
+ *
+ * Every request is a single line: the number of suggestions to return, followed by the uris of the
+ * features of the goal, separated by whitespace. Repeated features count as multiple occurrences,
+ * unknown features are ignored. The response is a single line of dependency uris and their scores,
+ * separated by spaces and ordered from best to worst, or "error <message>".
+ * The request "stats" returns the number of requests and batches and the latency percentiles.
+ *
+ * Requests of all clients are queued, and taken in batches by the worker threads;
+ * knn answers a batch in a single pass over the dataset.
+ */
+class server
+{
+public:
+	static constexpr size_t default_batch_size = 16;
+	static constexpr size_t default_k = 55;
+
+	struct options_t
+	{
+		ml_type ml = ml_type::knn;
+		size_t threads = 1;
+		size_t batch_size = default_batch_size;
+		size_t k = default_k;
+	};
+
+	// Sparse row of a query, which is not part of the dataset
+	class query_row_t
+	{
+	private:
+		std::vector<std::pair<feature_id_t, dataset_t::value_t>> entries;
+		size_t n;
+
+	public:
+		typedef std::vector<std::pair<feature_id_t, dataset_t::value_t>>::const_iterator iterator;
+
+		query_row_t(std::vector<std::pair<feature_id_t, dataset_t::value_t>>&& _entries, size_t _n)
+			: entries(std::move(_entries))
+			, n(_n)
+		{}
+
+		iterator begin() const
+		{
+			return entries.begin();
+		}
+
+		iterator end() const
+		{
+			return entries.end();
+		}
+
+		size_t size() const
+		{
+			return n;
+		}
+
+		size_t nonempty_size() const
+		{
+			return entries.size();
+		}
+	};
+
+private:
+	typedef std::chrono::steady_clock clock;
+	typedef compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> compact_t;
+	typedef std::vector<std::pair<dependency_id_t, float>> suggestions_t;
+
+	struct request_t
+	{
+		query_row_t row;
+		size_t top_n;
+		clock::time_point received;
+		std::promise<std::string> response;
+	};
+
+	options_t const opt;
+	dataset_t const d;
+	compact_t const trainingset;
+	std::unique_ptr<nb_preload_data_t const> nb_data;
+	std::shared_ptr<nb_log_tables_t<> const> nb_tables;
+	std::unordered_map<uri_t, feature_id_t> feature_map;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::unique_ptr<request_t>> queue;
+	bool done;
+
+	mutable std::mutex stats_mutex;
+	quantile_sketch_t latency; // In milliseconds
+	size_t requests, batches;
+
+	std::vector<std::thread> workers;
+
+	// Sockets of the clients of serve_socket, which are removed by their threads when done
+	std::mutex clients_mutex;
+	std::condition_variable clients_cv;
+	std::set<int> clients;
+
+	static std::future<std::string> ready(std::string const& response)
+	{
+		std::promise<std::string> p;
+		p.set_value(response);
+		return p.get_future();
+	}
+
+	std::unique_ptr<request_t> parse(std::string const& line) const
+	{
+		std::stringstream ss(line);
+
+		long top_n;
+		if(!(ss >> top_n) || top_n <= 0)
+			throw std::runtime_error("expected the number of suggestions");
+
+		std::vector<std::pair<feature_id_t, dataset_t::value_t>> entries;
+		std::string uri;
+		while(ss >> uri)
+		{
+			auto it = feature_map.find(uri);
+			if(it != feature_map.end())
+				entries.emplace_back(it->second, 1);
+		}
+
+		// Merge repeated features into their number of occurrences
+		std::sort(entries.begin(), entries.end());
+		std::vector<std::pair<feature_id_t, dataset_t::value_t>> row;
+		for(auto const& kvp : entries)
+		{
+			if(!row.empty() && row.back().first == kvp.first)
+				row.back().second++;
+			else
+				row.emplace_back(kvp);
+		}
+
+		return std::unique_ptr<request_t>(new request_t{
+			query_row_t(std::move(row), d.features.size()),
+			static_cast<size_t>(top_n),
+			clock::now(),
+			std::promise<std::string>()
+		});
+	}
+
+	std::string format(suggestions_t suggestions, size_t top_n) const
+	{
+		top_n = std::min(top_n, suggestions.size());
+		std::partial_sort(suggestions.begin(), suggestions.begin() + top_n, suggestions.end(), [](std::pair<dependency_id_t, float> const& x, std::pair<dependency_id_t, float> const& y) {
+			return x.second > y.second;
+		});
+
+		std::stringstream ss;
+		for(size_t i = 0; i < top_n; ++i)
+		{
+			if(i > 0)
+				ss << ' ';
+			ss << d.dependencies[suggestions[i].first] << ' ' << suggestions[i].second;
+		}
+		return ss.str();
+	}
+
+	std::vector<suggestions_t> predict(std::vector<query_row_t> const& rows) const
+	{
+		std::vector<suggestions_t> result;
+		switch(opt.ml)
+		{
+		case ml_type::knn:
+			return knn<compact_t>(opt.k, trainingset, d).predict_batch(rows);
+		case ml_type::knn_adaptive:
+			for(auto const& row : rows)
+				result.emplace_back(knn_adaptive<compact_t>(trainingset, d).predict(row));
+			return result;
+		case ml_type::naive_bayes:
+			for(auto const& row : rows)
+				result.emplace_back(naive_bayes<compact_t>(-15, 0, d, *nb_data, nb_tables, trainingset).predict(row));
+			return result;
+		default:
+			throw std::runtime_error("Method " + to_string(opt.ml) + " can not be served");
+		}
+	}
+
+	void work()
+	{
+		std::vector<std::unique_ptr<request_t>> batch;
+		std::vector<query_row_t> rows;
+		while(true)
+		{
+			batch.clear();
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [&]() { return done || !queue.empty(); });
+				if(queue.empty())
+					return; // Done
+
+				while(!queue.empty() && batch.size() < opt.batch_size)
+				{
+					batch.emplace_back(std::move(queue.front()));
+					queue.pop_front();
+				}
+			}
+
+			rows.clear();
+			for(auto const& r : batch)
+				rows.emplace_back(r->row);
+
+			std::vector<suggestions_t> predictions;
+			try
+			{
+				predictions = predict(rows);
+			} catch(std::exception const& e)
+			{
+				for(auto& r : batch)
+					r->response.set_value(std::string("error ") + e.what());
+				continue;
+			}
+
+			for(size_t i = 0; i < batch.size(); ++i)
+				batch[i]->response.set_value(format(std::move(predictions[i]), batch[i]->top_n));
+
+			auto const now = clock::now();
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			for(auto const& r : batch)
+				latency.add(std::chrono::duration<double, std::milli>(now - r->received).count());
+			requests += batch.size();
+			batches++;
+		}
+	}
+
+public:
+	// The dataset is consistentized, such that every dependency has an object
+	server(dataset_t const& d_orig, options_t const& _opt)
+		: opt(_opt)
+		, d(posetcons_canonical::consistentize(d_orig))
+		, trainingset(d.feature_matrix)
+		, nb_data()
+		, nb_tables()
+		, feature_map()
+		, mutex()
+		, cv()
+		, queue()
+		, done(false)
+		, stats_mutex()
+		, latency()
+		, requests(0)
+		, batches(0)
+		, workers()
+		, clients_mutex()
+		, clients_cv()
+		, clients()
+	{
+		if(opt.ml != ml_type::knn && opt.ml != ml_type::knn_adaptive && opt.ml != ml_type::naive_bayes)
+			throw std::runtime_error("Method " + to_string(opt.ml) + " can not be served");
+
+		if(opt.ml == ml_type::naive_bayes)
+		{
+			nb_data.reset(new nb_preload_data_t(d));
+			nb_tables = std::make_shared<nb_log_tables_t<> const>(10.0f);
+		}
+
+		d.features.iterate([&](feature_id_t i, uri_t const& uri) {
+			feature_map.emplace(uri, i);
+		});
+
+		for(size_t i = 0; i < std::max<size_t>(1, opt.threads); ++i)
+			workers.emplace_back([this]() { work(); });
+	}
+
+	server(server const&) = delete;
+
+	~server()
+	{
+		// Client threads still use this server; they are ended by serve_socket
+		{
+			std::unique_lock<std::mutex> lock(clients_mutex);
+			clients_cv.wait(lock, [&]() { return clients.empty(); });
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		cv.notify_all();
+
+		for(auto& t : workers)
+			t.join();
+	}
+
+	// Thread safe; the future holds the response line
+	std::future<std::string> submit(std::string const& line)
+	{
+		if(line == "stats")
+			return ready(stats());
+
+		std::unique_ptr<request_t> r;
+		try
+		{
+			r = parse(line);
+		} catch(std::runtime_error const& e)
+		{
+			return ready(std::string("error ") + e.what());
+		}
+
+		auto f = r->response.get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.emplace_back(std::move(r));
+		}
+		cv.notify_one();
+
+		return f;
+	}
+
+	std::string stats() const
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+
+		std::stringstream ss;
+		ss << "requests " << requests << " batches " << batches
+			<< " p50 " << latency.quantile(0.5) << "ms p99 " << latency.quantile(0.99) << "ms";
+		return ss.str();
+	}
+
+	// Answers the requests of a single client in order, until the end of the input
+	void serve(std::istream& is, std::ostream& os);
+
+	// Accepts clients on a Unix domain socket, until killed
+	void serve_socket(std::string const& path);
+};
+
+}
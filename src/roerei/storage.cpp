@@ -13,7 +13,13 @@
 
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace roerei
 {
@@ -69,11 +75,89 @@ inline std::string read_to_string(std::string const& filename)
 	return buf;
 }
 
+// Bounds the number of datasets which are read or written at the same time
+class io_slots_t
+{
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::size_t size, used;
+
+public:
+	io_slots_t()
+		: mutex()
+		, cv()
+		, size(2)
+		, used(0)
+	{}
+
+	void resize(std::size_t n)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			size = std::max<std::size_t>(1, n);
+		}
+		cv.notify_all();
+	}
+
+	std::size_t capacity()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return size;
+	}
+
+	template<typename F>
+	auto run(F const& f) -> decltype(f())
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() { return used < size; });
+			used++;
+		}
+
+		struct release_t
+		{
+			io_slots_t& slots;
+
+			~release_t()
+			{
+				{
+					std::lock_guard<std::mutex> lock(slots.mutex);
+					slots.used--;
+				}
+				slots.cv.notify_one();
+			}
+		} release{*this};
+
+		return f();
+	}
+};
+
+static io_slots_t& io_slots()
+{
+	static io_slots_t slots;
+	return slots;
+}
+
+// One store per path and type of result, which is read once per process
+template<typename T>
+static basic_results_store<T>& open_results(std::string const& path)
+{
+	static std::mutex mutex;
+	static std::map<std::string, std::unique_ptr<basic_results_store<T>>> stores;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& store = stores[path];
+	if(!store)
+		store.reset(new basic_results_store<T>(path));
+
+	return *store;
+}
+
 }
 
-void storage::read_summaries(std::function<void(summary_t&&)> const& f)
+void storage::read_summaries(std::function<void(summary_t&&)> const& f, std::string const& repo_path)
 {
-	static const std::string repo_path = "./data/repo.msgpack";
 	static const std::string __bogus = "__bogus";
 
 	auto read_freq_or_depth = [&](msgpack_deserializer& d) {
@@ -201,36 +285,64 @@ dataset_t storage::read_dataset(std::string const& corpus)
 	return deserialize<dataset_t>(d, "dataset");
 }
 
-void storage::read_result(std::function<void(cv_result_t)> const& f, std::string const& results_path)
+std::future<dataset_t> storage::read_dataset_async(std::string const& corpus)
 {
-	if(!boost::filesystem::exists(results_path))
-		return; // Do nothing
+	return std::async(std::launch::async, [corpus]() {
+		return detail::io_slots().run([&]() {
+			return read_dataset(corpus);
+		});
+	});
+}
 
-	msgpack_deserializer d;
-	d.feed(detail::read_to_string(results_path));
+std::future<void> storage::write_dataset_async(std::string const& corpus, dataset_t&& d)
+{
+	return std::async(std::launch::async, [corpus, d = std::move(d)]() {
+		detail::io_slots().run([&]() {
+			write_dataset(corpus, d);
+		});
+	});
+}
 
-	try
-	{
-		while(true)
-		{
-			f(deserialize<cv_result_t>(d, "cv_result_v2"));
-		}
-	} catch(eob_error)
+void storage::set_io_threads(size_t n)
+{
+	detail::io_slots().resize(n);
+}
+
+void storage::iterate_datasets(std::vector<std::string> const& corpii, std::function<void(std::string const&, dataset_t&&)> const& f)
+{
+	size_t const lookahead = detail::io_slots().capacity();
+
+	std::deque<std::future<dataset_t>> pending;
+	size_t next = 0;
+	for(size_t i = 0; i < corpii.size(); ++i)
 	{
-		// Done!
+		for(; next < corpii.size() && next <= i + lookahead; ++next)
+			pending.emplace_back(read_dataset_async(corpii[next]));
+
+		dataset_t d(pending.front().get());
+		pending.pop_front();
+		f(corpii[i], std::move(d));
 	}
 }
 
-void storage::write_result(cv_result_t const& result)
+results_store& storage::results(std::string const& results_path)
 {
-	msgpack_serializer s;
-	serialize(s, "cv_result_v2", result);
+	return detail::open_results<cv_result_t>(results_path);
+}
 
-	std::ofstream os("./data/results.msgpack", std::ios::app | std::ios::out | std::ios::binary);
-	s.dump([&os](const char* buf, size_t len) {
-		os.write(buf, len);
-		os.flush();
-	});
+fold_results_store& storage::fold_results(std::string const& fold_results_path)
+{
+	return detail::open_results<cv_fold_result_t>(fold_results_path);
+}
+
+void storage::read_result(std::function<void(cv_result_t)> const& f, std::string const& results_path)
+{
+	results(results_path).iterate(f);
+}
+
+void storage::write_result(cv_result_t const& result)
+{
+	results().add(result);
 }
 
 void storage::read_v1_result(std::function<void(cv_result_v1_t)> const& f, std::string const& results_path)
@@ -268,7 +380,7 @@ void storage::write_legacy_dataset(std::string const& path, dataset_t const& d)
 			os_symb << '"' << d.objects[row.row_i] << "\":";
 
 			bool first = true;
-            for(std::pair<feature_id_t, dataset_t::value_t> const kvp : row)
+            for(auto const& kvp : row)
 			{
 				if(first)
 					first = false;
@@ -287,7 +399,7 @@ void storage::write_legacy_dataset(std::string const& path, dataset_t const& d)
 			os_deps << '"' << d.objects[row.row_i] << "\":";
 
 			bool first = true;
-            for(std::pair<dependency_id_t, dataset_t::value_t> const kvp : row)
+            for(auto const& kvp : row)
 			{
 				if(first)
 					first = false;
@@ -4,8 +4,12 @@
 #include <roerei/mapping.hpp>
 #include <roerei/dataset.hpp>
 #include <roerei/cv_result.hpp>
+#include <roerei/results_store.hpp>
 
 #include <functional>
+#include <future>
+#include <string>
+#include <vector>
 
 namespace roerei
 {
@@ -16,9 +20,15 @@ private:
 	storage() = delete;
 
 public:
-	static void read_summaries(std::function<void(summary_t&&)> const& f);
+	static void read_summaries(std::function<void(summary_t&&)> const& f, std::string const& repo_path = "./data/repo.msgpack");
 	static void read_mapping(std::function<void(mapping_t&&)> const& f);
 
+	// The results in results_path, which are read once per process
+	static results_store& results(std::string const& results_path = "./data/results.msgpack");
+
+	// The metrics of the single folds of the crossvalidations of which not all folds are done yet
+	static fold_results_store& fold_results(std::string const& fold_results_path = "./data/folds.msgpack");
+
 	static void read_result(std::function<void(cv_result_t)> const& f, std::string const& results_path = "./data/results.msgpack");
 	static void write_result(cv_result_t const& r);
 
@@ -27,6 +37,16 @@ public:
 	static dataset_t read_dataset(std::string const& corpus);
 	static void write_dataset(std::string const& corpus, dataset_t const& d);
 
+	/* Asynchronous variants, of which at most io_threads datasets are read or written at the same time.
+	 * The future of a write has to be kept until the write is done; its destructor waits for it.
+	 */
+	static std::future<dataset_t> read_dataset_async(std::string const& corpus);
+	static std::future<void> write_dataset_async(std::string const& corpus, dataset_t&& d);
+	static void set_io_threads(size_t n);
+
+	// Calls f for every dataset in order, while the next datasets are read in the background
+	static void iterate_datasets(std::vector<std::string> const& corpii, std::function<void(std::string const&, dataset_t&&)> const& f);
+
 	static void write_legacy_dataset(std::string const& path, dataset_t const& d);
 };
 
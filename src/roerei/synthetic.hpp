@@ -0,0 +1,167 @@
+#pragma once
+
+#include <roerei/dataset.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace roerei
+{
+
+/* Generator of synthetic corpora, for scaling experiments beyond the size of the real corpora.
+ *
+ * The objects are divided in consecutive layers; every object depends on objects of earlier layers,
+ * half of the time of the directly preceding layer, such that the longest dependency chain is about
+ * as long as the number of layers. The feature frequencies follow a Zipf distribution, and part of
+ * the features of an object are inherited from its dependencies, such that objects which share
+ * features also share dependencies. The first objects form the prior.
+ */
+class synthetic
+{
+private:
+	synthetic() = delete;
+
+public:
+	struct params_t
+	{
+		size_t objects = 10000;
+		size_t features = 5000;
+		float features_per_object = 8.0f; // Mean number of feature occurrences of an object
+		float exponent = 1.1f; // Of the Zipf distribution of the features
+		float inherit = 0.5f; // Fraction of the features taken from the dependencies
+		size_t depth = 20; // Number of layers
+		float fan_out = 4.0f; // Mean number of dependencies of an object outside the first layer
+		float prior = 0.1f; // Fraction of the objects which are prior objects
+		uint_fast32_t seed = 1337;
+	};
+
+private:
+	// Samples the ranks 0..n-1 with a probability proportional to 1 / (rank+1)^exponent
+	class zipf_t
+	{
+	private:
+		std::vector<double> cdf;
+
+	public:
+		zipf_t(size_t n, float exponent)
+			: cdf(n)
+		{
+			double sum = 0.0;
+			for(size_t i = 0; i < n; ++i)
+			{
+				sum += 1.0 / std::pow(static_cast<double>(i + 1), exponent);
+				cdf[i] = sum;
+			}
+
+			for(double& x : cdf)
+				x /= sum;
+		}
+
+		template<typename GEN>
+		size_t operator()(GEN& gen) const
+		{
+			double const x = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+			size_t const i = std::lower_bound(cdf.begin(), cdf.end(), x) - cdf.begin();
+			return std::min(i, cdf.size() - 1);
+		}
+	};
+
+	static void validate(params_t const& p)
+	{
+		if(p.objects == 0 || p.features == 0)
+			throw std::runtime_error("A synthetic corpus requires objects and features");
+		if(p.depth == 0 || p.depth > p.objects)
+			throw std::runtime_error("The depth of a synthetic corpus must be between 1 and the number of objects");
+		if(p.inherit < 0.0f || p.inherit > 1.0f || p.prior < 0.0f || p.prior > 1.0f)
+			throw std::runtime_error("The inherited and prior fractions of a synthetic corpus must be between 0 and 1");
+	}
+
+public:
+	static dataset_t generate(params_t const& p)
+	{
+		validate(p);
+
+		std::mt19937 gen(p.seed);
+
+		std::vector<uri_t> object_uris, feature_uris;
+		object_uris.reserve(p.objects);
+		for(size_t i = 0; i < p.objects; ++i)
+			object_uris.emplace_back("synthetic:o" + std::to_string(i));
+		feature_uris.reserve(p.features);
+		for(size_t i = 0; i < p.features; ++i)
+			feature_uris.emplace_back("synthetic:f" + std::to_string(i));
+		std::vector<uri_t> dependency_uris(object_uris); // Every object can be used as a dependency
+
+		dataset_t d(std::move(object_uris), std::move(feature_uris), std::move(dependency_uris));
+
+		// The features are shuffled, such that the frequency of a feature is independent of its id
+		std::vector<size_t> feature_permutation(p.features);
+		std::iota(feature_permutation.begin(), feature_permutation.end(), 0);
+		std::shuffle(feature_permutation.begin(), feature_permutation.end(), gen);
+
+		zipf_t const zipf(p.features, p.exponent);
+		std::poisson_distribution<size_t> features_dis(std::max(p.features_per_object - 1.0f, 0.0f));
+		std::poisson_distribution<size_t> fan_out_dis(std::max(p.fan_out - 1.0f, 0.0f));
+		std::bernoulli_distribution inherit_dis(p.inherit), previous_layer_dis(0.5);
+
+		auto layer_begin = [&](size_t layer) {
+			return layer * p.objects / p.depth;
+		};
+
+		std::vector<size_t> deps;
+		std::vector<feature_id_t> inheritable, features;
+		for(size_t layer = 0; layer < p.depth; ++layer)
+		{
+			size_t const begin = layer_begin(layer), end = layer_begin(layer + 1);
+			for(size_t i = begin; i < end; ++i)
+			{
+				deps.clear();
+				if(layer > 0)
+				{
+					std::uniform_int_distribution<size_t> all_dis(0, begin - 1), previous_dis(layer_begin(layer - 1), begin - 1);
+					for(size_t j = 1 + fan_out_dis(gen); j > 0; --j)
+						deps.emplace_back(previous_layer_dis(gen) ? previous_dis(gen) : all_dis(gen));
+
+					std::sort(deps.begin(), deps.end());
+					deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+				}
+
+				inheritable.clear();
+				for(size_t j : deps)
+					for(auto const& kvp : d.feature_matrix[object_id_t(j)])
+						inheritable.emplace_back(kvp.first);
+
+				features.clear();
+				for(size_t j = 1 + features_dis(gen); j > 0; --j)
+				{
+					if(!inheritable.empty() && inherit_dis(gen))
+						features.emplace_back(inheritable[std::uniform_int_distribution<size_t>(0, inheritable.size() - 1)(gen)]);
+					else
+						features.emplace_back(feature_permutation[zipf(gen)]);
+				}
+
+				// Repeated features count as multiple occurrences
+				auto row = d.feature_matrix[object_id_t(i)];
+				for(feature_id_t f : features)
+					row[f]++;
+
+				auto dep_row = d.dependency_matrix[object_id_t(i)];
+				for(size_t j : deps)
+					dep_row[dependency_id_t(j)] = 1;
+			}
+		}
+
+		size_t const prior_objects = static_cast<size_t>(p.prior * static_cast<float>(p.objects));
+		for(size_t i = 0; i < prior_objects; ++i)
+			d.prior_objects.emplace_hint(d.prior_objects.end(), i);
+
+		return d;
+	}
+};
+
+}
@@ -30,11 +30,17 @@ private:
 	tester() = delete;
 
 public:
-	inline static void order(multitask& m, std::string const& corpus, posetcons_type strat, ml_type method, bool prior=true, bool silent=false, bool do_cv = true, uint_fast32_t seed = 1337)
+	// d_orig is the dataset of corpus, as read by storage
+	inline static void order(multitask& m, std::string const& corpus, dataset_t const& d_orig, posetcons_type strat, ml_type method, bool prior=true, bool silent=false, bool do_cv = true, uint_fast32_t seed = 1337, size_t jobs = 1, trace::sink_t* trace_sink = nullptr, std::string const& trace_dir = "./data/traces")
 	{
 		size_t const cv_n = do_cv ? cv::default_n : 1;
 		size_t const cv_k = do_cv ? cv::default_k : 1;
 
+		/* The folds already run concurrently, and keep all jobs busy until the last folds are started; from then
+		 * on the training of a fold borrows the workers which became idle, up to all jobs
+		 */
+		size_t const train_threads = std::max<size_t>(1, jobs);
+
 		std::set<knn_params_t> ks;
 		std::set<nb_params_t> nbs;
 		std::set<adarank_params_t> as;
@@ -104,78 +110,95 @@ public:
 			break;
 		}
 
-		size_t i = 0;
-		storage::read_result([&](cv_result_t const& result) {
-			if(result.corpus != corpus)
-				return;
-
-			if(result.strat != strat)
-				return;
-
-			if(result.prior != prior)
-				return;
+		// Skip the parameters of which the results are already known
+		results_store const& results = storage::results();
+		auto done_f = [&](ml_type ml, boost::optional<knn_params_t> knn_params, boost::optional<nb_params_t> nb_params, boost::optional<adarank_params_t> adarank_params) {
+			return results.contains(results_store::key_t(corpus, prior, strat, ml, knn_params, nb_params, adarank_params, cv_n, cv_k));
+		};
 
-			if(cv_n != result.n)
-				return;
-
-			if(cv_k != result.k)
-				return;
-
-			switch(result.ml)
-			{
-			case ml_type::knn:
-			{
-				size_t skipped = ks.erase(*result.knn_params);
-				i += skipped;
-				break;
-			}
-			case ml_type::naive_bayes:
+		size_t i = 0;
+		auto skip_f = [&](auto& params, auto const& done_params_f) {
+			for(auto it = params.begin(); it != params.end();)
 			{
-				size_t skipped = nbs.erase(*result.nb_params);
-
-				if(skipped > 1) {
-					std::cerr << "Double" << std::endl;
+				if(done_params_f(*it))
+				{
+					it = params.erase(it);
+					i++;
 				}
-
-				i += skipped;
-				break;
+				else
+					++it;
 			}
-			case ml_type::knn_adaptive:
-				run_knn_adaptive = false;
-				break;
-			case ml_type::omniscient:
-				run_omniscient = false;
-				break;
-			case ml_type::ensemble:
-				run_ensemble = false;
-				break;
-			case ml_type::adarank:
-			{
-				size_t skipped = as.erase(*result.adarank_params);
+		};
 
-				if(skipped > 1) {
-					std::cerr << "Double" << std::endl;
-				}
-
-				i += skipped;
-				break;
-			}
-			}
-		});
+		skip_f(ks, [&](knn_params_t const& p) { return done_f(ml_type::knn, p, boost::none, boost::none); });
+		skip_f(nbs, [&](nb_params_t const& p) { return done_f(ml_type::naive_bayes, boost::none, p, boost::none); });
+		skip_f(as, [&](adarank_params_t const& p) { return done_f(ml_type::adarank, boost::none, boost::none, p); });
+		run_knn_adaptive = run_knn_adaptive && !done_f(ml_type::knn_adaptive, boost::none, boost::none, boost::none);
+		run_omniscient = run_omniscient && !done_f(ml_type::omniscient, boost::none, boost::none, boost::none);
+		run_ensemble = run_ensemble && !done_f(ml_type::ensemble, boost::none, boost::none, boost::none);
 
 		std::cerr << "Skipped " << i << std::endl;
 		std::cerr << "Read results" << std::endl;
 
-		auto const d_orig(storage::read_dataset(corpus));
 		auto const d_ptr(std::make_shared<dataset_t>(posetcons_canonical::consistentize(d_orig, seed)));
 		auto const& d = *d_ptr;
 		cv const c(d, cv_n, cv_k, seed);
 
+		/* Resume the jobsets of which some folds were done before, and checkpoint every fold as it is done.
+		 * Only the folds of the same partition of the same dataset are resumed.
+		 */
+		fold_results_store const& fold_results = storage::fold_results();
+		uint64_t const fingerprint = d_orig.fingerprint();
+		size_t const folds = c.folds();
+		size_t resumed = 0;
+		auto checkpoint_f([&](ml_type ml, boost::optional<knn_params_t> knn_params, boost::optional<nb_params_t> nb_params, boost::optional<adarank_params_t> adarank_params) {
+			cv_fold_result_t const base{{corpus, prior, strat, ml, knn_params, nb_params, adarank_params, cv_n, cv_k, performance::metrics_t()}, seed, fingerprint, 0};
+
+			cv::checkpoint_t checkpoint;
+			for(size_t fold = 0; fold < folds; ++fold)
+			{
+				auto const r(fold_results.find(fold_results_store::key_t(results_store::key(base.result), seed, fingerprint, fold)));
+				if(r)
+					checkpoint.done.emplace(fold, r->result.metrics);
+			}
+			resumed += checkpoint.done.size();
+
+			checkpoint.fold_f = [base](size_t fold, performance::metrics_t const& metrics) {
+				cv_fold_result_t r(base);
+				r.result.metrics = metrics;
+				r.fold = fold;
+				storage::fold_results().add(r);
+			};
+
+			return checkpoint;
+		});
+
 		static std::mutex os_mutex;
 		auto yield_f([&](cv_result_t const& result) {
 			std::lock_guard<std::mutex> lock(os_mutex);
 			storage::write_result(result);
 			std::cout << result << std::endl;
+
+			// The checkpoints of the folds are dropped once the result is durable, also those of other partitions
+			storage::results().flush();
+			auto const k(results_store::key(result));
+			storage::fold_results().erase_if([&](cv_fold_result_t const& r) {
+				return results_store::key(r.result) == k;
+			});
+		});
+
+		// Names the jobset after its parameters, as used for its trace and events
+		auto name_f([&](ml_type ml, std::string const& params) {
+			std::stringstream ss;
+			ss << corpus << '-' << strat << '-' << ml;
+			if(!params.empty())
+				ss << '-' << params;
+			if(!prior)
+				ss << "-noprior";
+			if(!do_cv)
+				ss << "-nocv";
+
+			return ss.str();
 		});
 
 		std::cerr << "Scheduling..." << std::endl;
@@ -190,13 +213,15 @@ public:
 						return [&, gen_trainset_sane_f_ptr, knn_params](cv::testrow_t const& test_row) {
 							auto const trainset_sane((*gen_trainset_sane_f_ptr)(trainset, test_row));
 							knn<decltype(trainset_sane)> ml(knn_params.k, trainset_sane, *d_ptr);
-							return performance::measure(*d_ptr, test_row.row_i, ml.predict(test_row));
+							return ml.predict(test_row);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::knn, knn_params, boost::none, boost::none, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::knn, "K" + std::to_string(knn_params.k)), trace_sink, trace_dir,
+					checkpoint_f(ml_type::knn, knn_params, boost::none, boost::none)
 				);
 			}
 
@@ -207,13 +232,15 @@ public:
 						return [&, gen_trainset_sane_f_ptr](cv::testrow_t const& test_row) {
 							auto const trainset_sane((*gen_trainset_sane_f_ptr)(trainset, test_row));
 							knn_adaptive<decltype(trainset_sane)> ml(trainset_sane, *d_ptr);
-							return performance::measure(*d_ptr, test_row.row_i, ml.predict(test_row));
+							return ml.predict(test_row);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::knn_adaptive, boost::none, boost::none, boost::none, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::knn_adaptive, ""), trace_sink, trace_dir,
+					checkpoint_f(ml_type::knn_adaptive, boost::none, boost::none, boost::none)
 				);
 			}
 
@@ -223,13 +250,15 @@ public:
 					[d_ptr, gen_trainset_sane_f_ptr](cv::trainset_t const&) {
 						return [&, gen_trainset_sane_f_ptr](cv::testrow_t const& test_row) {
 							omniscient ml(*d_ptr);
-							return performance::measure(*d_ptr, test_row.row_i, ml.predict(test_row));
+							return ml.predict(test_row);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::omniscient, boost::none, boost::none, boost::none, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::omniscient, ""), trace_sink, trace_dir,
+					checkpoint_f(ml_type::omniscient, boost::none, boost::none, boost::none)
 				);
 			}
 
@@ -239,9 +268,12 @@ public:
 				if(!nb_data)
 					nb_data = std::make_shared<nb_preload_data_t>(d);
 
+				// Built once for all folds and rows, rather than for every instance
+				auto const nb_tables(std::make_shared<nb_log_tables_t<> const>(10.0f));
+
 				c.order_async(m,
-					[d_ptr, gen_trainset_sane_f_ptr, nb_data](cv::trainset_t const& trainset) {
-						return [&, gen_trainset_sane_f_ptr, nb_data](cv::testrow_t const& test_row) {
+					[d_ptr, gen_trainset_sane_f_ptr, nb_data, nb_tables](cv::trainset_t const& trainset) {
+						return [&, gen_trainset_sane_f_ptr, nb_data, nb_tables](cv::testrow_t const& test_row) {
 							auto const trainset_sane((*gen_trainset_sane_f_ptr)(trainset, test_row));
 							ensemble<cv::testrow_t> e_ml(*d_ptr);
 
@@ -251,22 +283,25 @@ public:
 							}, 0.5f);
 
 							naive_bayes<decltype(trainset_sane)> nb_ml(
-								10, -15, 0,
+								-15, 0,
 								*d_ptr,
 								*nb_data,
+								nb_tables,
 								trainset_sane
 							);
 							e_ml.add_predictor([&nb_ml, test_row_id=test_row.row_i](auto row) {
 								return nb_ml.predict(row, test_row_id); // TODO remove the use of test_row_id, when time allows
 							}, 0.5f);
 
-							return performance::measure(*d_ptr, test_row.row_i, e_ml.predict(test_row));
+							return e_ml.predict(test_row);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::ensemble, boost::none, boost::none, boost::none, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::ensemble, ""), trace_sink, trace_dir,
+					checkpoint_f(ml_type::ensemble, boost::none, boost::none, boost::none)
 				);
 			}
 
@@ -275,40 +310,51 @@ public:
 				if(!nb_data)
 					nb_data = std::make_shared<nb_preload_data_t>(d);
 
+				auto const nb_tables(std::make_shared<nb_log_tables_t<> const>(nb_params.pi));
+
 				c.order_async(m,
-					[d_ptr, gen_trainset_sane_f_ptr, nb_data, nb_params](cv::trainset_t const& trainset) {
+					[d_ptr, gen_trainset_sane_f_ptr, nb_data, nb_params, nb_tables](cv::trainset_t const& trainset) {
 						return [&, gen_trainset_sane_f_ptr](cv::testrow_t const& test_row) {
 							auto const trainset_sane((*gen_trainset_sane_f_ptr)(trainset, test_row));
 							naive_bayes<decltype(trainset_sane)> ml(
-								nb_params.pi, nb_params.sigma, nb_params.tau,
+								nb_params.sigma, nb_params.tau,
 								*d_ptr,
 								*nb_data,
+								nb_tables,
 								trainset_sane
 							);
-							return performance::measure(*d_ptr, test_row.row_i, ml.predict(test_row, test_row.row_i));
+							return ml.predict(test_row, test_row.row_i);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::naive_bayes, boost::none, nb_params, boost::none, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::naive_bayes, [&]() {
+						std::stringstream ss;
+						ss << nb_params.pi << '_' << nb_params.sigma << '_' << nb_params.tau;
+						return ss.str();
+					}()), trace_sink, trace_dir,
+					checkpoint_f(ml_type::naive_bayes, boost::none, nb_params, boost::none)
 				);
 			}
 
 			for(adarank_params_t const& adarank_params : as)
 			{
 				c.order_async(m,
-					[d_ptr, gen_trainset_sane_f_ptr, adarank_params](cv::trainset_t const& trainset) noexcept {
-						adarank ml(adarank_params.T, *d_ptr, trainset);
+					[d_ptr, gen_trainset_sane_f_ptr, adarank_params, train_threads](cv::trainset_t const& trainset) noexcept {
+						adarank ml(adarank_params.T, *d_ptr, trainset, train_threads);
 						return [&, gen_trainset_sane_f_ptr, ml=std::move(ml)](cv::testrow_t const& test_row) {
 							auto const trainset_sane((*gen_trainset_sane_f_ptr)(trainset, test_row));
-							return performance::measure(*d_ptr, test_row.row_i, ml.predict(test_row, trainset_sane));
+							return ml.predict(test_row, trainset_sane);
 						};
 					},
 					[=](performance::metrics_t const& total_metrics) noexcept {
 						yield_f({corpus, prior, strat, ml_type::adarank, boost::none, boost::none, adarank_params, cv_n, cv_k, total_metrics});
 					},
-					d, prior, silent
+					d, prior, silent,
+					name_f(ml_type::adarank, "T" + std::to_string(adarank_params.T)), trace_sink, trace_dir,
+					checkpoint_f(ml_type::adarank, boost::none, boost::none, adarank_params)
 				);
 			}
 		});
@@ -341,6 +387,7 @@ public:
 		}
 
 		std::cerr << "Scheduled" << std::endl;
+		std::cerr << "Resumed " << resumed << " folds" << std::endl;
 	}
 };
 
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <roerei/performance.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+namespace roerei
+{
+
+/* Per test row results of a jobset, appended to a binary columnar file.
+ *
+ * header: "roereitr", uint32 version, uint32 top_n, uint32 length and the description
+ * block: uint32 rows, followed by the columns with a value for each row:
+ *   fold, row (uint32), oocover, cover, ooprecision, recall, rank, auc, volume (float) and
+ *   the number of suggestions (uint32), followed by the concatenated top suggestions of all
+ *   rows as dependency (uint32) and score (float) columns.
+ * All values are in host byte order.
+ */
+class trace
+{
+private:
+	trace() = delete;
+
+	static constexpr char const* magic = "roereitr";
+	static constexpr uint32_t current_version = 1;
+
+public:
+	static constexpr size_t default_top_n = 10;
+	static constexpr size_t default_block_size = 1024;
+
+	struct block_t
+	{
+		std::vector<uint32_t> fold, row;
+		std::vector<float> oocover, cover, ooprecision, recall, rank, auc, volume;
+		std::vector<uint32_t> suggestion_count;
+		std::vector<uint32_t> suggestion_dependency;
+		std::vector<float> suggestion_score;
+
+		size_t size() const
+		{
+			return row.size();
+		}
+
+		void add(size_t _fold, object_id_t _row, performance::metrics_t const& m, std::vector<std::pair<dependency_id_t, float>> const& suggestions, size_t top_n, std::vector<std::pair<dependency_id_t, float>>& top_buffer)
+		{
+			fold.emplace_back(_fold);
+			row.emplace_back(_row.unseal());
+			oocover.emplace_back(m.oocover);
+			cover.emplace_back(m.cover);
+			ooprecision.emplace_back(m.ooprecision);
+			recall.emplace_back(m.recall);
+			rank.emplace_back(m.rank);
+			auc.emplace_back(m.auc);
+			volume.emplace_back(m.volume);
+
+			top_buffer.resize(std::min(top_n, suggestions.size()), std::make_pair(dependency_id_t(0), 0.0f));
+			std::partial_sort_copy(suggestions.begin(), suggestions.end(), top_buffer.begin(), top_buffer.end(), [](std::pair<dependency_id_t, float> const& x, std::pair<dependency_id_t, float> const& y) {
+				return x.second > y.second;
+			});
+
+			suggestion_count.emplace_back(top_buffer.size());
+			for(auto const& kvp : top_buffer)
+			{
+				suggestion_dependency.emplace_back(kvp.first.unseal());
+				suggestion_score.emplace_back(kvp.second);
+			}
+		}
+
+		// The rows of which the fold satisfies f
+		template<typename F>
+		block_t select(F const& f) const
+		{
+			block_t b;
+			size_t offset = 0;
+			for(size_t j = 0; j < size(); offset += suggestion_count[j], ++j)
+			{
+				if(!f(fold[j]))
+					continue;
+
+				b.fold.emplace_back(fold[j]);
+				b.row.emplace_back(row[j]);
+				b.oocover.emplace_back(oocover[j]);
+				b.cover.emplace_back(cover[j]);
+				b.ooprecision.emplace_back(ooprecision[j]);
+				b.recall.emplace_back(recall[j]);
+				b.rank.emplace_back(rank[j]);
+				b.auc.emplace_back(auc[j]);
+				b.volume.emplace_back(volume[j]);
+				b.suggestion_count.emplace_back(suggestion_count[j]);
+				b.suggestion_dependency.insert(b.suggestion_dependency.end(), suggestion_dependency.begin() + offset, suggestion_dependency.begin() + offset + suggestion_count[j]);
+				b.suggestion_score.insert(b.suggestion_score.end(), suggestion_score.begin() + offset, suggestion_score.begin() + offset + suggestion_count[j]);
+			}
+
+			return b;
+		}
+	};
+
+private:
+	template<typename T>
+	static void write_value(std::ostream& os, T const x)
+	{
+		os.write(reinterpret_cast<char const*>(&x), sizeof(T));
+	}
+
+	template<typename T>
+	static void write_column(std::ostream& os, std::vector<T> const& xs)
+	{
+		os.write(reinterpret_cast<char const*>(xs.data()), xs.size() * sizeof(T));
+	}
+
+	template<typename T>
+	static T read_value(std::istream& is)
+	{
+		T x;
+		if(!is.read(reinterpret_cast<char*>(&x), sizeof(T)))
+			throw std::runtime_error("Unexpected end of trace");
+		return x;
+	}
+
+	template<typename T>
+	static void read_column(std::istream& is, std::vector<T>& xs, size_t n)
+	{
+		xs.resize(n);
+		if(!is.read(reinterpret_cast<char*>(xs.data()), n * sizeof(T)))
+			throw std::runtime_error("Unexpected end of trace");
+	}
+
+	static void write_block(std::ostream& os, block_t const& b)
+	{
+		write_value<uint32_t>(os, b.size());
+		write_column(os, b.fold);
+		write_column(os, b.row);
+		write_column(os, b.oocover);
+		write_column(os, b.cover);
+		write_column(os, b.ooprecision);
+		write_column(os, b.recall);
+		write_column(os, b.rank);
+		write_column(os, b.auc);
+		write_column(os, b.volume);
+		write_column(os, b.suggestion_count);
+		write_column(os, b.suggestion_dependency);
+		write_column(os, b.suggestion_score);
+	}
+
+public:
+	/* A trace is only opened when its first block is written, and is closed explicitly, such that
+	 * only the traces of the running jobsets are open at the same time.
+	 *
+	 * When a jobset is resumed, the rows of the folds in done_folds are kept from the earlier trace, except
+	 * for a torn block at its end; the rows of the other folds are dropped, as these folds are run again.
+	 */
+	class file_t
+	{
+	private:
+		std::string const path, description;
+		std::set<size_t> const done_folds;
+		std::ofstream os;
+		bool failed;
+
+		void write_header(std::ostream& os_header) const
+		{
+			os_header.write(magic, std::strlen(magic));
+			write_value<uint32_t>(os_header, current_version);
+			write_value<uint32_t>(os_header, top_n);
+			write_value<uint32_t>(os_header, description.size());
+			os_header.write(description.data(), description.size());
+		}
+
+		void open() /* Writer thread */
+		{
+			failed = true;
+			if(done_folds.empty())
+			{
+				os.open(path, std::ios::binary | std::ios::trunc);
+				if(!os)
+					throw std::runtime_error("Could not open trace " + path);
+
+				write_header(os);
+				failed = false;
+				return;
+			}
+
+			std::string const tmp_path(path + ".tmp");
+			{
+				std::ofstream os_tmp(tmp_path, std::ios::binary | std::ios::trunc);
+				if(!os_tmp)
+					throw std::runtime_error("Could not open trace " + tmp_path);
+
+				write_header(os_tmp);
+				try
+				{
+					read(path, [&](std::string const&, size_t, block_t const& b) {
+						block_t const kept(b.select([&](uint32_t fold) {
+							return done_folds.find(fold) != done_folds.end();
+						}));
+
+						if(kept.size() > 0)
+							write_block(os_tmp, kept);
+					});
+				} catch(std::runtime_error const&)
+				{
+					// No earlier trace, or the rest of it is torn
+				}
+
+				if(!os_tmp.flush())
+					throw std::runtime_error("Could not write trace " + tmp_path);
+			}
+
+			if(std::rename(tmp_path.c_str(), path.c_str()) != 0)
+				throw std::runtime_error("Could not replace trace " + path);
+
+			os.open(path, std::ios::binary | std::ios::app);
+			if(!os)
+				throw std::runtime_error("Could not open trace " + path);
+
+			failed = false;
+		}
+
+	public:
+		size_t const top_n;
+
+		file_t(std::string const& _path, std::string const& _description, size_t _top_n, std::set<size_t> const& _done_folds)
+			: path(_path)
+			, description(_description)
+			, done_folds(_done_folds)
+			, os()
+			, failed(false)
+			, top_n(_top_n)
+		{}
+
+		void append(block_t const& b) /* Writer thread */
+		{
+			if(failed)
+				return;
+
+			if(!os.is_open())
+				open();
+
+			write_block(os, b);
+			if(!os.flush())
+			{
+				failed = true;
+				throw std::runtime_error("Could not write trace " + path);
+			}
+		}
+
+		void close() /* Writer thread */
+		{
+			if(!os.is_open())
+				return;
+
+			os.close();
+			if(!os && !failed)
+				throw std::runtime_error("Could not close trace " + path);
+		}
+	};
+
+	/* Appends blocks to their files from a single writer thread, in the order in which they were submitted.
+	 * When a trace cannot be written, its remaining blocks are dropped, and the first failure is rethrown by flush.
+	 */
+	class sink_t
+	{
+	private:
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<std::pair<std::shared_ptr<file_t>, boost::optional<block_t>>> queue; // Without a block to close the file
+		size_t queued, written;
+		std::exception_ptr error;
+		bool done;
+		std::thread writer;
+
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while(true)
+			{
+				cv.wait(lock, [&]() { return done || !queue.empty(); });
+				if(queue.empty())
+					return; // Done
+
+				auto item(std::move(queue.front()));
+				queue.pop_front();
+
+				lock.unlock();
+				std::exception_ptr e;
+				try
+				{
+					if(item.second)
+						item.first->append(*item.second);
+					else
+						item.first->close();
+				} catch(std::runtime_error const&)
+				{
+					e = std::current_exception();
+				}
+				item.first.reset();
+				lock.lock();
+
+				if(e && !error)
+					error = e;
+
+				written++;
+				cv.notify_all();
+			}
+		}
+
+		void enqueue(std::shared_ptr<file_t> const& file, boost::optional<block_t>&& block)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.emplace_back(file, std::move(block));
+				queued++;
+			}
+			cv.notify_all();
+		}
+
+	public:
+		sink_t()
+			: mutex()
+			, cv()
+			, queue()
+			, queued(0)
+			, written(0)
+			, error()
+			, done(false)
+			, writer()
+		{
+			writer = std::thread([this]() { run(); });
+		}
+
+		sink_t(sink_t const&) = delete;
+
+		~sink_t()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				done = true;
+			}
+			cv.notify_all();
+			writer.join();
+		}
+
+		std::shared_ptr<file_t> open(std::string const& path, std::string const& description, size_t top_n = default_top_n, std::set<size_t> const& done_folds = std::set<size_t>())
+		{
+			return std::make_shared<file_t>(path, description, top_n, done_folds);
+		}
+
+		void submit(std::shared_ptr<file_t> const& file, block_t&& block)
+		{
+			if(block.size() == 0)
+				return;
+
+			enqueue(file, std::move(block));
+		}
+
+		// After the blocks which were submitted before
+		void close(std::shared_ptr<file_t> const& file)
+		{
+			enqueue(file, boost::none);
+		}
+
+		// Waits until all submitted blocks and closes have been written, and rethrows the first failure to write them
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() { return written == queued; });
+			if(error)
+				std::rethrow_exception(error);
+		}
+	};
+
+	template<typename F>
+	static void read(std::string const& path, F const& f)
+	{
+		std::ifstream is(path, std::ios::binary);
+		if(!is)
+			throw std::runtime_error("Could not open trace " + path);
+
+		std::string m(std::strlen(magic), '\0');
+		if(!is.read(&m[0], m.size()) || m != magic)
+			throw std::runtime_error("Not a trace: " + path);
+
+		if(read_value<uint32_t>(is) != current_version)
+			throw std::runtime_error("Unsupported trace version: " + path);
+
+		size_t const top_n = read_value<uint32_t>(is);
+		std::string description(read_value<uint32_t>(is), '\0');
+		if(!is.read(&description[0], description.size()))
+			throw std::runtime_error("Unexpected end of trace");
+
+		block_t b;
+		while(is.peek() != std::char_traits<char>::eof())
+		{
+			size_t const n = read_value<uint32_t>(is);
+			read_column(is, b.fold, n);
+			read_column(is, b.row, n);
+			read_column(is, b.oocover, n);
+			read_column(is, b.cover, n);
+			read_column(is, b.ooprecision, n);
+			read_column(is, b.recall, n);
+			read_column(is, b.rank, n);
+			read_column(is, b.auc, n);
+			read_column(is, b.volume, n);
+			read_column(is, b.suggestion_count, n);
+
+			size_t suggestions = 0;
+			for(uint32_t c : b.suggestion_count)
+				suggestions += c;
+
+			read_column(is, b.suggestion_dependency, suggestions);
+			read_column(is, b.suggestion_score, suggestions);
+
+			f(description, top_n, b);
+		}
+	}
+};
+
+}
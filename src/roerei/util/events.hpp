@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <sys/resource.h>
+
+namespace roerei
+{
+
+/* Stream of progress and profiling events, written as JSON lines: one object per line with the
+ * seconds since the stream was opened as "time", the type as "event" and the event specific
+ * fields. Numbers are written with enough digits to be read back exactly. Emitting is a no-op as
+ * long as no stream has been opened.
+ */
+class events
+{
+private:
+	events() = delete;
+
+	typedef std::chrono::steady_clock clock;
+
+	struct stream_t
+	{
+		std::mutex mutex;
+		std::ofstream os;
+		std::atomic<bool> enabled;
+		clock::time_point start;
+
+		stream_t()
+			: mutex()
+			, os()
+			, enabled(false)
+			, start(clock::now())
+		{}
+	};
+
+	static stream_t& stream()
+	{
+		static stream_t s;
+		return s;
+	}
+
+	static void write_string(std::ostream& os, std::string const& str)
+	{
+		os << '"';
+		for(char c : str)
+		{
+			switch(c)
+			{
+			case '"':
+				os << "\\\"";
+				break;
+			case '\\':
+				os << "\\\\";
+				break;
+			case '\n':
+				os << "\\n";
+				break;
+			default:
+				if(static_cast<unsigned char>(c) < 0x20)
+					os << ' ';
+				else
+					os << c;
+			}
+		}
+		os << '"';
+	}
+
+public:
+	class event_t
+	{
+	private:
+		std::string const type;
+		std::stringstream fields;
+
+	public:
+		event_t(std::string const& _type)
+			: type(_type)
+			, fields()
+		{
+			fields << std::setprecision(std::numeric_limits<double>::max_digits10);
+		}
+
+		event_t& operator()(std::string const& key, std::string const& value)
+		{
+			fields << ',';
+			write_string(fields, key);
+			fields << ':';
+			write_string(fields, value);
+			return *this;
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_arithmetic<T>::value, event_t&>::type operator()(std::string const& key, T const value)
+		{
+			fields << ',';
+			write_string(fields, key);
+			fields << ':' << value;
+			return *this;
+		}
+
+		friend class events;
+	};
+
+	// A path of /dev/fd/<n> writes to an already opened file descriptor
+	static void open(std::string const& path)
+	{
+		auto& s = stream();
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		s.os.open(path, std::ios::out | std::ios::trunc);
+		if(!s.os)
+			throw std::runtime_error("Could not open event stream " + path);
+
+		s.os << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+		s.start = clock::now();
+		s.enabled = true;
+	}
+
+	static void close()
+	{
+		auto& s = stream();
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		s.enabled = false;
+		s.os.close();
+	}
+
+	static bool enabled()
+	{
+		return stream().enabled;
+	}
+
+	static void emit(event_t const& e)
+	{
+		auto& s = stream();
+		if(!s.enabled)
+			return;
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.os << "{\"time\":" << std::chrono::duration<double>(clock::now() - s.start).count() << ",\"event\":";
+		write_string(s.os, e.type);
+		s.os << e.fields.str() << '}' << std::endl;
+	}
+
+	// Peak resident set size of the process in kilobytes
+	static long peak_rss_kb()
+	{
+		struct rusage usage;
+		if(getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+
+		return usage.ru_maxrss;
+	}
+};
+
+}
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define ROEREI_FAST_LOG_AVX2
+#endif
 
 namespace roerei
 {
@@ -10,14 +17,15 @@ namespace impl
 {
 
 /* natural log on [0x1.f7a5ecp-127, 0x1.fffffep127]. Maximum relative error 9.4529e-5 */
-float fast_log(float a)
+inline float fast_log(float a)
 {
 	float m, r, s, t, i, f;
-	int32_t e, m_int;
+	int32_t e, m_int, a_int;
 
-	e = (*reinterpret_cast<int32_t*>(&a) - 0x3f2aaaab) & 0xff800000;
-	m_int = *reinterpret_cast<int32_t*>(&a) - e;
-	m = *reinterpret_cast<float*>(&m_int);
+	std::memcpy(&a_int, &a, sizeof(a));
+	e = (a_int - 0x3f2aaaab) & static_cast<int32_t>(0xff800000);
+	m_int = a_int - e;
+	std::memcpy(&m, &m_int, sizeof(m));
 	i = static_cast<float>(e) * 1.19209290e-7f; // 0x1.0p-23
 	/* m in [2/3, 4/3] */
 	f = m - 1.0f;
@@ -31,11 +39,167 @@ float fast_log(float a)
 	return r;
 }
 
+/* log1p on (-1, 0x1.fffffep127], computed as log(u) * x / (u - 1) with u = 1 + x.
+ * The correction factor compensates for the rounding of u, so that the relative
+ * error of fast_log carries over to small x. Maximum relative error 1.0e-4
+ */
+inline float fast_log1p(float x)
+{
+	float u = 1.0f + x;
+	float d = u - 1.0f;
+	if(d == 0.0f)
+		return x;
+
+	return fast_log(u) * (x / d);
+}
+
+#ifdef ROEREI_FAST_LOG_AVX2
+
+/* Eight-wide variant of fast_log; identical results */
+inline __m256 fast_log_avx2(__m256 a)
+{
+	__m256i const a_int = _mm256_castps_si256(a);
+	__m256i const e = _mm256_and_si256(
+		_mm256_sub_epi32(a_int, _mm256_set1_epi32(0x3f2aaaab)),
+		_mm256_set1_epi32(static_cast<int32_t>(0xff800000))
+	);
+	__m256 const m = _mm256_castsi256_ps(_mm256_sub_epi32(a_int, e));
+	__m256 const i = _mm256_mul_ps(_mm256_cvtepi32_ps(e), _mm256_set1_ps(1.19209290e-7f));
+
+	__m256 const f = _mm256_sub_ps(m, _mm256_set1_ps(1.0f));
+	__m256 const s = _mm256_mul_ps(f, f);
+
+	__m256 r = _mm256_fmadd_ps(_mm256_set1_ps(0.230836749f), f, _mm256_set1_ps(-0.279208571f));
+	__m256 const t = _mm256_fmadd_ps(_mm256_set1_ps(0.331826031f), f, _mm256_set1_ps(-0.498910338f));
+	r = _mm256_fmadd_ps(r, s, t);
+	r = _mm256_fmadd_ps(r, s, f);
+	r = _mm256_fmadd_ps(i, _mm256_set1_ps(0.693147182f), r);
+	return r;
+}
+
+inline __m256 fast_log_avx2_nonpositive(__m256 a, __m256 r)
+{
+	// log(0) = -inf, log(x < 0) = NaN; like std::log
+	__m256 const zero = _mm256_setzero_ps();
+	r = _mm256_blendv_ps(r, _mm256_set1_ps(NAN), _mm256_cmp_ps(a, zero, _CMP_LT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_set1_ps(-INFINITY), _mm256_cmp_ps(a, zero, _CMP_EQ_OQ));
+	return r;
+}
+
+inline __m256 fast_log1p_avx2(__m256 x)
+{
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const u = _mm256_add_ps(one, x);
+	__m256 const d = _mm256_sub_ps(u, one);
+	__m256 const exact = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_EQ_OQ);
+
+	__m256 const r = _mm256_mul_ps(
+		fast_log_avx2_nonpositive(u, fast_log_avx2(u)),
+		_mm256_div_ps(x, _mm256_blendv_ps(d, one, exact))
+	);
+	return _mm256_blendv_ps(r, x, exact);
+}
+
+#endif
+
 }
 
-float fast_log(float a)
+/* Policy used by the scoring loops of the predictors: the math library */
+class exact_log
+{
+private:
+	exact_log() = delete;
+
+public:
+	static inline float log(float x)
+	{
+		return std::log(x);
+	}
+
+	static inline float log1p(float x)
+	{
+		return std::log1p(x);
+	}
+
+	static inline void log(float* xs, size_t n)
+	{
+		for(size_t i = 0; i < n; ++i)
+			xs[i] = std::log(xs[i]);
+	}
+
+	static inline void log1p(float* xs, size_t n)
+	{
+		for(size_t i = 0; i < n; ++i)
+			xs[i] = std::log1p(xs[i]);
+	}
+};
+
+/* Policy used by the scoring loops of the predictors: polynomial approximation.
+ * Maximum relative error of log is 9.4529e-5 on positive normal floats, of log1p 1.0e-4 on
+ * floats greater than -1. log(0) yields -inf, log of a negative number NaN.
+ * The batch variants use AVX2 when compiled with support for it.
+ */
+class approximate_log
+{
+private:
+	approximate_log() = delete;
+
+public:
+	static inline float log(float x)
+	{
+		if(x <= 0.0f)
+			return x == 0.0f ? -INFINITY : NAN;
+
+		return impl::fast_log(x);
+	}
+
+	static inline float log1p(float x)
+	{
+		if(x <= -1.0f)
+			return log(1.0f + x);
+
+		return impl::fast_log1p(x);
+	}
+
+	static inline void log(float* xs, size_t n)
+	{
+		size_t i = 0;
+
+#ifdef ROEREI_FAST_LOG_AVX2
+		for(; i + 8 <= n; i += 8)
+		{
+			__m256 const x = _mm256_loadu_ps(xs + i);
+			_mm256_storeu_ps(xs + i, impl::fast_log_avx2_nonpositive(x, impl::fast_log_avx2(x)));
+		}
+#endif
+
+		for(; i < n; ++i)
+			xs[i] = log(xs[i]);
+	}
+
+	static inline void log1p(float* xs, size_t n)
+	{
+		size_t i = 0;
+
+#ifdef ROEREI_FAST_LOG_AVX2
+		for(; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(xs + i, impl::fast_log1p_avx2(_mm256_loadu_ps(xs + i)));
+#endif
+
+		for(; i < n; ++i)
+			xs[i] = log1p(xs[i]);
+	}
+};
+
+#ifdef ROEREI_FAST_LOG
+typedef approximate_log default_log_t;
+#else
+typedef exact_log default_log_t;
+#endif
+
+inline float fast_log(float a)
 {
-	return std::log(a);
+	return default_log_t::log(a);
 }
 
 }
@@ -1,18 +1,15 @@
 #pragma once
 
-#include <roerei/util/timer.hpp>
-#include <roerei/util/guard.hpp>
-
-#include <boost/optional.hpp>
-
-#include <map>
-#include <vector>
-#include <stack>
-#include <memory>
+#include <array>
 #include <chrono>
-#include <string>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace roerei
 {
@@ -20,140 +17,291 @@ namespace roerei
 namespace test
 {
 
+/* Hierarchical profiler of performance_scope's.
+ * Every call site interns its name once; entering a scope then only looks up the child of the
+ * current node in a small vector, and leaving it adds the duration to fixed counters.
+ * Every thread has its own tree, which is merged into a global tree on clear() and thread exit.
+ * Defining ROEREI_NO_PROFILER compiles all scopes out.
+ */
 class performance
 {
 public:
-	typedef std::string key_t;
-	typedef std::chrono::microseconds time_t;
+	typedef uint32_t scope_id_t;
+	typedef std::chrono::steady_clock clock;
+
+	static constexpr size_t histogram_size = 40; // Buckets of [2^i, 2^(i+1)) nanoseconds
+
+	struct counters_t
+	{
+		uint64_t count, total, min, max; // In nanoseconds
+		std::array<uint64_t, histogram_size> histogram;
+
+		counters_t()
+			: count(0)
+			, total(0)
+			, min(std::numeric_limits<uint64_t>::max())
+			, max(0)
+			, histogram()
+		{}
+
+		static size_t bucket(uint64_t ns)
+		{
+			if(ns == 0)
+				return 0;
+
+			size_t b = 63 - __builtin_clzll(ns);
+			return b < histogram_size ? b : histogram_size - 1;
+		}
+
+		void add(uint64_t ns)
+		{
+			count++;
+			total += ns;
+			min = ns < min ? ns : min;
+			max = ns > max ? ns : max;
+			histogram[bucket(ns)]++;
+		}
+
+		void merge(counters_t const& rhs)
+		{
+			count += rhs.count;
+			total += rhs.total;
+			min = rhs.min < min ? rhs.min : min;
+			max = rhs.max > max ? rhs.max : max;
+			for(size_t i = 0; i < histogram_size; ++i)
+				histogram[i] += rhs.histogram[i];
+		}
+	};
 
 private:
 	struct node_t
 	{
-		std::vector<time_t> durations;
-		std::map<key_t, std::shared_ptr<node_t>> children;
+		scope_id_t scope;
+		counters_t counters;
+		std::vector<std::pair<scope_id_t, size_t>> children; // Scope -> index of node
+
+		node_t(scope_id_t _scope)
+			: scope(_scope)
+			, counters()
+			, children()
+		{}
 	};
 
-	std::shared_ptr<node_t> root;
-	std::stack<std::shared_ptr<node_t>> stack;
+	std::vector<node_t> nodes; // The root is the first node
+	std::vector<size_t> stack;
+	bool merge_on_exit;
 
-	static thread_local boost::optional<performance> singleton;
+	struct registry_t
+	{
+		std::mutex mutex;
+		std::vector<std::string> names;
+		std::unique_ptr<performance> merged;
+
+		registry_t()
+			: mutex()
+			, names({"root"})
+			, merged(new performance(false))
+		{}
+	};
 
-public:
-	performance()
-		: root(std::make_shared<node_t>())
-		, stack()
+	static registry_t& registry()
 	{
-		stack.emplace(root);
+		static registry_t r;
+		return r;
 	}
 
-	static performance& init()
+	performance(bool _merge_on_exit)
+		: nodes()
+		, stack()
+		, merge_on_exit(_merge_on_exit)
 	{
-		if(!singleton)
-			singleton.reset(performance());
-
-		return *singleton;
+		nodes.emplace_back(0);
+		stack.reserve(16);
+		stack.emplace_back(0);
 	}
 
-	static void clear()
+	size_t child(size_t parent, scope_id_t scope)
 	{
-		singleton.reset();
+		for(auto const& kvp : nodes[parent].children)
+			if(kvp.first == scope)
+				return kvp.second;
+
+		size_t i = nodes.size();
+		nodes.emplace_back(scope);
+		nodes[parent].children.emplace_back(scope, i);
+		return i;
 	}
 
-	void operator()(key_t const& key, timer const& t)
+	void merge_into(performance& dst, size_t dst_i, size_t src_i) const
 	{
-		auto node = stack.top()->children.emplace(std::make_pair(key, std::make_shared<node_t>())).first->second;
-		node->durations.emplace_back(t.diff_msec());
+		dst.nodes[dst_i].counters.merge(nodes[src_i].counters);
+		for(size_t c = 0; c < nodes[src_i].children.size(); ++c)
+		{
+			auto const kvp = nodes[src_i].children[c];
+			merge_into(dst, dst.child(dst_i, kvp.first), kvp.second);
+		}
 	}
 
-	void enter(key_t const& key)
+	void reset_counters()
 	{
-		auto next_node = stack.top()->children.emplace(std::make_pair(key, std::make_shared<node_t>())).first->second;
-		stack.emplace(next_node);
+		for(auto& node : nodes)
+			node.counters = counters_t();
 	}
 
-	void leave(key_t const& key, timer const& t)
+	void merge_into_registry()
 	{
-		stack.pop();
-		(*this)(key, t);
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		merge_into(*r.merged, 0, 0);
 	}
 
-	template<typename F>
-	auto operator()(key_t const& key, F f) -> typename std::result_of<F()>::type
+	void report(std::vector<std::string> const& names, size_t i, size_t indent) const
 	{
-		timer t;
-		enter(std::move(key));
+		node_t const& node = nodes[i];
+
+		std::cerr << std::string(indent, ' ');
+		if(indent == 0) // Special root case
+			std::cerr << names[node.scope] << std::endl;
+		else
+			std::cerr << names[node.scope] << ": " << node.counters.total / 1000 << "µs"
+				<< " (" << node.counters.count << "x, min " << node.counters.min << "ns, max " << node.counters.max << "ns)" << std::endl;
 
-		auto g(make_guard([&]() {
-			leave(key, t);
-		}));
+		uint64_t subtotal = 0;
+		for(auto const& kvp : node.children)
+		{
+			report(names, kvp.second, indent+1);
+			subtotal += nodes[kvp.second].counters.total;
+		}
 
-		return f();
+		if(indent > 0 && !node.children.empty() && node.counters.total > subtotal)
+			std::cerr << std::string(indent+1, ' ') << "missing: " << (node.counters.total - subtotal) / 1000 << "µs" << std::endl;
 	}
 
-	static void note_time(key_t const& key, timer const& t)
+public:
+	performance(performance&&) = default;
+	performance(performance const&) = delete;
+
+	~performance()
 	{
-		if(!singleton)
-			throw std::runtime_error("Singleton performance measurements are not initialized");
+		if(merge_on_exit)
+			merge_into_registry();
+	}
 
-		(*singleton)(key, t);
+	static scope_id_t intern(char const* name)
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.names.emplace_back(name);
+		return r.names.size() - 1;
 	}
 
-	template<typename F>
-	static auto measure(key_t const& key, F f) -> typename std::result_of<F()>::type
+	// The tree of the current thread
+	static performance& init()
+	{
+		static thread_local performance p(true);
+		return p;
+	}
+
+	// Moves the counters of the current thread to the global tree
+	static void clear()
 	{
-		if(!singleton)
-			throw std::runtime_error("Singleton performance measurements are not initialized");
+		auto& p = init();
+		p.merge_into_registry();
+		p.reset_counters();
+	}
 
-		return (*singleton)(key, f);
+	size_t enter(scope_id_t scope)
+	{
+		size_t i = child(stack.back(), scope);
+		stack.emplace_back(i);
+		return i;
 	}
 
-	void print_indentation(std::ostream& os, size_t indent)
+	void leave(size_t i, uint64_t ns)
 	{
-		os << std::string(indent, ' ');
+		nodes[i].counters.add(ns);
+		stack.pop_back();
 	}
 
-	time_t report(node_t const& node, key_t const& key, size_t indent = 0)
+	class scope_t
 	{
-		time_t total = time_t::zero();
-		for(time_t const& d : node.durations)
-			total += d;
+	private:
+		performance& p;
+		size_t const i;
+		clock::time_point const start;
 
-		print_indentation(std::cerr, indent);
-		if(indent == 0) // Special root case
-			std::cerr << key << std::endl;
-		else
-			std::cerr << key << ": " << total.count() << "µs" << std::endl;
+	public:
+		scope_t(scope_id_t scope)
+			: p(init())
+			, i(p.enter(scope))
+			, start(clock::now())
+		{}
 
-		time_t subtotal = time_t::zero();
-		for(auto const& child_tup : node.children)
-			subtotal += report(*child_tup.second, child_tup.first, indent+1);
+		scope_t(scope_t const&) = delete;
 
-		time_t missing = total - subtotal;
-		if(node.children.size() > 0 && missing.count() > 0)
+		~scope_t()
 		{
-			print_indentation(std::cerr, indent+1);
-			std::cerr << "missing: " << missing.count() << "µs" << std::endl;
+			p.leave(i, std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
 		}
+	};
 
-		return total;
+	// Calls f with the path of names and the counters of every node of the merged tree, depth first
+	template<typename F>
+	static void iterate_merged(F const& f)
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+
+		std::vector<std::string> path;
+		std::function<void(size_t)> visit([&](size_t i) {
+			node_t const& node = r.merged->nodes[i];
+			if(i != 0)
+			{
+				path.emplace_back(r.names[node.scope]);
+				f(path, node.counters);
+			}
+
+			for(auto const& kvp : node.children)
+				visit(kvp.second);
+
+			if(i != 0)
+				path.pop_back();
+		});
+		visit(0);
 	}
 
-	void report()
+	// Reports the tree of the current thread
+	void report() const
 	{
-		report(*root, "root");
+		std::vector<std::string> names;
+		{
+			auto& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			names = r.names;
+		}
+
+		report(names, 0, 0);
+	}
+
+	// Reports the tree merged over all threads
+	static void report_merged()
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.merged->report(r.names, 0, 0);
 	}
 };
 
+#ifdef ROEREI_NO_PROFILER
+#define performance_scope(name)
+#else
 #define performance_scope(name) \
-	timer _performance_t; \
-	std::string _performance_name(name); \
-	test::performance::init().enter(_performance_name); \
-	auto _performance_guard(make_guard([&]() { test::performance::init().leave(_performance_name, _performance_t); }));
+	static test::performance::scope_id_t const _performance_id(test::performance::intern(name)); \
+	test::performance::scope_t const _performance_scope(_performance_id);
+#endif
 
 #define performance_func performance_scope(__func__)
 
-#define register_performance decltype(roerei::test::performance::singleton) thread_local roerei::test::performance::singleton;
-
 }
 
 }
@@ -3,19 +3,58 @@
 #include <roerei/generic/sparse_matrix.hpp>
 #include <roerei/generic/sliced_sparse_matrix.hpp>
 #include <roerei/generic/compact_sparse_matrix.hpp>
+#include <roerei/generic/wl_sparse_matrix.hpp>
+#include <roerei/generic/bl_sparse_matrix.hpp>
+#include <roerei/generic/split_sparse_matrix.hpp>
+#include <roerei/generic/row_mask.hpp>
 #include <roerei/generic/sparse_unit_matrix.hpp>
 #include <roerei/generic/full_unit_matrix.hpp>
 
 #include <roerei/generic/id_t.hpp>
-
+#include <roerei/generic/multitask.hpp>
+#include <roerei/generic/quantile_sketch.hpp>
+
+#include <roerei/ml/naive_bayes.hpp>
+#include <roerei/ml/adarank.hpp>
+#include <roerei/ml/cv.hpp>
+#include <roerei/ml/posetcons_canonical.hpp>
+#include <roerei/ml/posetcons_optimistic.hpp>
+#include <roerei/ml/posetcons_pessimistic.hpp>
+
+#include <roerei/generator.hpp>
+#include <roerei/results_store.hpp>
+#include <roerei/serialization/serialize_fusion.hpp>
+#include <roerei/serialization/deserialize_fusion.hpp>
+#include <roerei/serialization/msgpack_serializer.hpp>
+#include <roerei/serialization/msgpack_deserializer.hpp>
+#include <roerei/server.hpp>
+#include <roerei/synthetic.hpp>
+#include <roerei/trace.hpp>
+
+#include <roerei/util/events.hpp>
+#include <roerei/util/fast_log.hpp>
+#include <roerei/util/performance.hpp>
+
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <map>
 #include <memory>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <iostream>
 #include <algorithm>
+#include <numeric>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
 
 #include <check.h>
 
+std::atomic<size_t> roerei::multitask::jobset_t::jobset_count(0);
+
 std::map<std::pair<roerei::object_id_t, roerei::object_id_t>, uint16_t> create_mat(size_t m, size_t n, size_t c)
 {
 	std::map<std::pair<roerei::object_id_t, roerei::object_id_t>, uint16_t> result;
@@ -76,6 +115,38 @@ START_TEST(test_matrix_iter_eq) // Preserve values after init with iter access
 }
 END_TEST
 
+START_TEST(test_matrix_builder_eq) // Finalized builder equals assigning in the same order
+{
+	size_t const m = 1000, n = 1000, c = 10000;
+
+	std::random_device rd;
+	std::mt19937 gen(rd());
+	std::uniform_int_distribution<> i_dis(0, m-1);
+	std::uniform_int_distribution<> j_dis(0, n-1);
+	std::uniform_int_distribution<> v_dis(0, std::numeric_limits<uint16_t>::max());
+
+	typedef roerei::sparse_matrix_t<roerei::object_id_t, roerei::object_id_t, uint16_t> matrix_t;
+	matrix_t mat(m, n);
+	matrix_t::builder_t builder(m, n);
+
+	// Includes repeated coordinates, of which the last value is kept
+	for(size_t t = 0; t < c; ++t)
+	{
+		roerei::object_id_t const i(i_dis(gen)), j(j_dis(gen) % 100);
+		uint16_t const v = v_dis(gen);
+		mat[i][j] = v;
+		builder.add(i, j, v);
+	}
+
+	matrix_t const built(builder.finalize());
+	mat.citerate([&](matrix_t::const_row_proxy_t const& row) {
+		auto const built_row = built[row.row_i];
+		ck_assert_int_eq(row.nonempty_size(), built_row.nonempty_size());
+		ck_assert(std::equal(row.begin(), row.end(), built_row.begin()));
+	});
+}
+END_TEST
+
 START_TEST(test_sliced_matrix_iter_eq) // Preserve values after init with iter access
 {
 	size_t const m = 1000, n = 1000, c = 10000;
@@ -148,6 +219,145 @@ auto create_default_cyclic()
     return m;
 }
 
+START_TEST(test_try_row) // Rows are looked up consistently without exceptions
+{
+	using namespace roerei;
+
+	size_t const m = 100, n = 10;
+	typedef sparse_matrix_t<object_id_t, feature_id_t, uint16_t> matrix_t;
+	matrix_t mat(m, n);
+	for(size_t i = 0; i < m; ++i)
+		mat[object_id_t(i)][feature_id_t(i % n)] = i + 1;
+
+	ck_assert(mat.contains(object_id_t(m - 1)) && !mat.contains(object_id_t(m)));
+	ck_assert(!mat.try_row(object_id_t(m)));
+	ck_assert_int_eq(mat.try_row(object_id_t(42))->row_i.unseal(), 42);
+	ck_assert_int_eq((*mat.try_row(object_id_t(42)))[feature_id_t(2)], 43);
+	ck_assert_int_eq((*mat.try_row(object_id_t(42)))[feature_id_t(3)], 0);
+
+	// Only the even rows are present in the compact matrix
+	sliced_sparse_matrix_t<matrix_t const> even_tmp(mat, false);
+	for(size_t i = 0; i < m; i += 2)
+		even_tmp.add_key(object_id_t(i));
+	ck_assert(even_tmp.contains(object_id_t(2)) && !even_tmp.contains(object_id_t(3)));
+	ck_assert(!even_tmp.try_row(object_id_t(3)));
+
+	compact_sparse_matrix_t<object_id_t, feature_id_t, uint16_t> const even(even_tmp);
+	ck_assert(even.contains(object_id_t(2)) && !even.contains(object_id_t(3)));
+	ck_assert(!even.try_row(object_id_t(3)));
+	ck_assert_int_eq(even.try_row(object_id_t(2))->begin()->second, 3);
+
+	std::vector<object_id_t> const listed({object_id_t(1), object_id_t(2), object_id_t(3), object_id_t(4)});
+	row_mask_t<object_id_t> wl_mask, bl_mask;
+	wl_sparse_matrix_t<decltype(even)> const wl(even, listed, wl_mask);
+	bl_sparse_matrix_t<decltype(even)> const bl(even, listed, bl_mask);
+	split_sparse_matrix_t<decltype(even)> const split(even, object_id_t(50));
+
+	for(size_t i = 0; i < m; ++i)
+	{
+		object_id_t const id(i);
+		bool const present = i % 2 == 0, is_listed = i >= 1 && i <= 4;
+		ck_assert(wl.contains(id) == (present && is_listed) && bool(wl.try_row(id)) == wl.contains(id));
+		ck_assert(bl.contains(id) == (present && !is_listed) && bool(bl.try_row(id)) == bl.contains(id));
+		ck_assert(split.contains(id) == (present && i < 50) && bool(split.try_row(id)) == split.contains(id));
+	}
+
+	std::vector<size_t> visited;
+	wl.citerate([&](decltype(even)::const_row_proxy_t const& row) {
+		visited.emplace_back(row.row_i.unseal());
+	});
+	ck_assert(visited == std::vector<size_t>({2, 4}));
+}
+END_TEST
+
+START_TEST(test_row_mask) // Views mark their rows while they exist, also when moved
+{
+	using namespace roerei;
+
+	typedef sparse_matrix_t<object_id_t, feature_id_t, uint16_t> matrix_t;
+	matrix_t mat(10, 1);
+	std::vector<object_id_t> const listed({object_id_t(3), object_id_t(7)});
+
+	row_mask_t<object_id_t>& mask = row_mask_t<object_id_t>::local(mat.size_m());
+	{
+		auto make_view = [&]() {
+			return bl_sparse_matrix_t<matrix_t>(mat, listed, mask);
+		};
+		auto const bl(make_view());
+		ck_assert(mask[object_id_t(3)] && mask[object_id_t(7)] && !mask[object_id_t(4)]);
+
+		size_t rows = 0;
+		bl.citerate([&](matrix_t::const_row_proxy_t const& row) {
+			ck_assert(row.row_i.unseal() != 3 && row.row_i.unseal() != 7);
+			rows++;
+		});
+		ck_assert_int_eq(rows, 8);
+	}
+
+	for(size_t i = 0; i < mat.size_m(); ++i)
+		ck_assert(!mask[object_id_t(i)]);
+	ck_assert(&mask == &row_mask_t<object_id_t>::local(2 * mat.size_m()));
+
+	// Every thread has its own mask
+	row_mask_t<object_id_t>* other = nullptr;
+	std::thread([&]() {
+		other = &row_mask_t<object_id_t>::local(mat.size_m());
+	}).join();
+	ck_assert(other != &mask);
+}
+END_TEST
+
+START_TEST(test_ranged_citerate) // Ranged iteration visits the same rows as filtering all rows
+{
+	using namespace roerei;
+
+	size_t const m = 100, n = 10;
+	typedef sparse_matrix_t<object_id_t, feature_id_t, uint16_t> matrix_t;
+	matrix_t mat(m, n);
+	for(size_t i = 0; i < m; ++i)
+		mat[object_id_t(i)][feature_id_t(i % n)] = i + 1;
+
+	sliced_sparse_matrix_t<matrix_t const> sliced(mat, false);
+	for(size_t i = 0; i < m; i += 3)
+		sliced.add_key(object_id_t(i));
+	compact_sparse_matrix_t<object_id_t, feature_id_t, uint16_t> const compact(sliced);
+
+	auto expected = [&](size_t begin, size_t end) {
+		std::vector<size_t> result;
+		compact.citerate([&](decltype(compact)::const_row_proxy_t const& row) {
+			if(row.row_i.unseal() >= begin && row.row_i.unseal() < end)
+				result.emplace_back(row.row_i.unseal());
+		});
+		return result;
+	};
+
+	for(auto const& range : std::vector<std::pair<size_t, size_t>>({{0, 0}, {0, 1}, {1, 3}, {10, 50}, {0, m}, {90, 2 * m}}))
+	{
+		std::vector<size_t> from_compact, from_sliced, from_sparse;
+		compact.citerate(object_id_t(range.first), object_id_t(range.second), [&](decltype(compact)::const_row_proxy_t const& row) {
+			from_compact.emplace_back(row.row_i.unseal());
+		});
+		sliced.citerate(object_id_t(range.first), object_id_t(range.second), [&](matrix_t::const_row_proxy_t const& row) {
+			from_sliced.emplace_back(row.row_i.unseal());
+		});
+		mat.citerate(object_id_t(range.first), object_id_t(range.second), [&](matrix_t::const_row_proxy_t const& row) {
+			if(row.row_i.unseal() % 3 == 0)
+				from_sparse.emplace_back(row.row_i.unseal());
+		});
+
+		ck_assert(from_compact == expected(range.first, range.second));
+		ck_assert(from_sliced == from_compact && from_sparse == from_compact);
+	}
+
+	std::vector<size_t> from_split;
+	split_sparse_matrix_t<decltype(compact)> const split(compact, object_id_t(50));
+	split.citerate([&](decltype(compact)::const_row_proxy_t const& row) {
+		from_split.emplace_back(row.row_i.unseal());
+	});
+	ck_assert(from_split == expected(0, 50));
+}
+END_TEST
+
 START_TEST(test_sparse_unit_matrix_transitive)
 {
   auto m(create_default_cyclic());
@@ -309,6 +519,1057 @@ START_TEST(test_transitive)
 }
 END_TEST
 
+START_TEST(test_approximate_log_error)
+{
+  std::mt19937 gen(1337);
+  std::uniform_real_distribution<float> exp_dis(-100.0f, 100.0f);
+
+  std::vector<float> xs;
+  for(size_t i = 0; i < 100000; ++i) {
+    xs.emplace_back(std::pow(2.0f, exp_dis(gen)));
+  }
+
+  std::vector<float> logs(xs), log1ps(xs);
+  roerei::approximate_log::log(logs.data(), logs.size());
+  roerei::approximate_log::log1p(log1ps.data(), log1ps.size());
+
+  for(size_t i = 0; i < xs.size(); ++i) {
+    double const log_x = std::log(static_cast<double>(xs[i]));
+    double const log1p_x = std::log1p(static_cast<double>(xs[i]));
+
+    ck_assert(std::abs(logs[i] - log_x) <= 1.0e-4 * std::abs(log_x) + 1.0e-7);
+    ck_assert(std::abs(log1ps[i] - log1p_x) <= 1.0e-4 * log1p_x);
+    ck_assert(logs[i] == roerei::approximate_log::log(xs[i]));
+  }
+
+  float edge[] = {0.0f, -1.0f};
+  roerei::approximate_log::log(edge, 2);
+  ck_assert(std::isinf(edge[0]) && edge[0] < 0.0f);
+  ck_assert(std::isnan(edge[1]));
+}
+END_TEST
+
+START_TEST(test_index_uris)
+{
+  using namespace roerei;
+
+  dataset_t d1(std::vector<uri_t>{"u:a", "u:b", "u:c"}, std::vector<uri_t>{"u:f"}, std::vector<uri_t>{"u:x", "u:c", "u:a"});
+  dataset_t d2(std::vector<uri_t>{"u:c", "u:a"}, std::vector<uri_t>{"u:f"}, std::vector<uri_t>{"u:a", "u:y"});
+
+  // Objects and dependencies with the same uri are matched, within each dataset
+  ck_assert(!d1.dependency_objects[dependency_id_t(0)]);
+  ck_assert(d1.dependency_objects[dependency_id_t(1)] == object_id_t(2));
+  ck_assert(d1.dependency_objects[dependency_id_t(2)] == object_id_t(0));
+  ck_assert(d1.object_dependencies[object_id_t(0)] == dependency_id_t(2));
+  ck_assert(!d1.object_dependencies[object_id_t(1)]);
+  ck_assert(d2.dependency_objects[dependency_id_t(0)] == object_id_t(1));
+  ck_assert(!d2.dependency_objects[dependency_id_t(1)]);
+
+  std::map<dependency_id_t, object_id_t> const expected{{dependency_id_t(1), object_id_t(2)}, {dependency_id_t(2), object_id_t(0)}};
+  ck_assert(d1.create_dependency_map() == expected);
+  std::map<object_id_t, dependency_id_t> const expected_rev{{object_id_t(0), dependency_id_t(2)}, {object_id_t(2), dependency_id_t(1)}};
+  ck_assert(d1.create_dependency_revmap() == expected_rev);
+
+  // Updated along when objects are appended
+  d1.objects.emplace_back("u:x");
+  d1.index_uris();
+  ck_assert(d1.dependency_objects[dependency_id_t(0)] == object_id_t(3));
+  ck_assert(d1.object_dependencies[object_id_t(3)] == dependency_id_t(0));
+}
+END_TEST
+
+roerei::dataset_t create_dataset(size_t const objects, size_t const features, size_t seed = 1337)
+{
+  std::mt19937 gen(seed);
+
+  std::vector<roerei::uri_t> object_uris, feature_uris;
+  for(size_t i = 0; i < objects; ++i) {
+    object_uris.emplace_back("o" + std::to_string(i));
+  }
+  for(size_t i = 0; i < features; ++i) {
+    feature_uris.emplace_back("f" + std::to_string(i));
+  }
+  std::vector<roerei::uri_t> dependency_uris(object_uris); // Every object can be used as a dependency
+
+  roerei::dataset_t d(std::move(object_uris), std::move(feature_uris), std::move(dependency_uris));
+
+  // Features of related objects overlap, such that the predictors have something to find
+  std::uniform_int_distribution<size_t> f_dis(0, features-1), v_dis(1, 4), n_dis(1, 4);
+  for(size_t i = 0; i < objects; ++i) {
+    auto row = d.feature_matrix[roerei::object_id_t(i)];
+    for(size_t j = 0; j < 6; ++j) {
+      row[roerei::feature_id_t((i + f_dis(gen) % 8) % features)] = v_dis(gen);
+    }
+    row[roerei::feature_id_t(f_dis(gen))] = v_dis(gen);
+
+    if(i == 0) {
+      continue;
+    }
+
+    auto deps = d.dependency_matrix[roerei::object_id_t(i)];
+    std::uniform_int_distribution<size_t> dep_dis(i > 8 ? i-8 : 0, i-1);
+    for(size_t j = n_dis(gen); j > 0; --j) {
+      deps[roerei::dependency_id_t(dep_dis(gen))] = 1;
+    }
+  }
+
+  return d;
+}
+
+template<typename LOG>
+roerei::performance::metrics_t measure_nb(roerei::dataset_t const& d)
+{
+  roerei::nb_preload_data_t const pld(d);
+  roerei::compact_sparse_matrix_t<roerei::object_id_t, roerei::feature_id_t, roerei::dataset_t::value_t> const m(d.feature_matrix);
+
+  roerei::performance::metrics_t result;
+  m.citerate([&](auto const& test_row) {
+    auto const trainset(roerei::posetcons_canonical::exec(m, test_row));
+    roerei::naive_bayes<decltype(trainset), LOG> ml(10, -1, 0, d, pld, trainset);
+    result += roerei::performance::measure(d, test_row.row_i, ml.predict(test_row, test_row.row_i)).metrics;
+  });
+  return result;
+}
+
+template<typename LOG>
+roerei::performance::metrics_t measure_adarank(roerei::dataset_t const& d, size_t threads = 1)
+{
+  roerei::compact_sparse_matrix_t<roerei::object_id_t, roerei::feature_id_t, roerei::dataset_t::value_t> const m(d.feature_matrix);
+  roerei::basic_adarank<LOG> const ml(3, d, m, threads);
+
+  roerei::performance::metrics_t result;
+  m.citerate([&](auto const& test_row) {
+    auto const trainset(roerei::posetcons_canonical::exec(m, test_row));
+    result += roerei::performance::measure(d, test_row.row_i, ml.predict(test_row, trainset)).metrics;
+  });
+  return result;
+}
+
+void check_metrics_drift(roerei::performance::metrics_t const& x, roerei::performance::metrics_t const& y, float epsilon)
+{
+  ck_assert(x.n == y.n);
+  ck_assert(std::abs(x.oocover - y.oocover) <= epsilon);
+  ck_assert(std::abs(x.cover - y.cover) <= epsilon);
+  ck_assert(std::abs(x.ooprecision - y.ooprecision) <= epsilon);
+  ck_assert(std::abs(x.auc - y.auc) <= epsilon);
+  ck_assert(std::abs(x.volume - y.volume) <= epsilon);
+  ck_assert(std::abs(x.rank - y.rank) <= epsilon * x.rank);
+}
+
+START_TEST(test_approximate_log_metrics_drift)
+{
+  roerei::test::performance::init();
+
+  auto const d(roerei::posetcons_canonical::consistentize(create_dataset(300, 150)));
+
+  check_metrics_drift(measure_nb<roerei::exact_log>(d), measure_nb<roerei::approximate_log>(d), 0.01f);
+  check_metrics_drift(measure_adarank<roerei::exact_log>(d), measure_adarank<roerei::approximate_log>(d), 0.01f);
+
+  roerei::test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_adarank_threads)
+{
+  roerei::test::performance::init();
+
+  auto const d(roerei::posetcons_canonical::consistentize(create_dataset(300, 150)));
+  check_metrics_drift(measure_adarank<roerei::exact_log>(d, 1), measure_adarank<roerei::exact_log>(d, 4), 0.0f);
+
+  roerei::test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_adarank_requirements) // Adjusting the requirements of the fold ranks as building them from scratch
+{
+  using namespace roerei;
+  test::performance::init();
+
+  auto const d(posetcons_canonical::consistentize(create_dataset(300, 150)));
+  compact_sparse_matrix_t<object_id_t, feature_id_t, dataset_t::value_t> const m(d.feature_matrix);
+  basic_adarank<exact_log> const ml(2, d, m);
+
+  size_t below = 0, above = 0;
+  auto check_f = [&](auto const& test_row, auto const& trainset) {
+    size_t included = 0;
+    trainset.citerate([&](auto const&) { included++; });
+    if(m.size_m() - included > included)
+      above++;
+    else
+      below++;
+
+    auto const adjusted(ml.predict(test_row, trainset, basic_adarank<exact_log>::requirements_e::adjusted));
+    auto const scratch(ml.predict(test_row, trainset, basic_adarank<exact_log>::requirements_e::scratch));
+    ck_assert(adjusted.size() == scratch.size());
+    for(size_t i = 0; i < adjusted.size(); ++i)
+    {
+      ck_assert(adjusted[i].first == scratch[i].first);
+      ck_assert(adjusted[i].second == scratch[i].second);
+    }
+  };
+
+  posetcons_optimistic const optimistic(d);
+  posetcons_pessimistic const pessimistic(d);
+  size_t rows = 0;
+  m.citerate([&](auto const& test_row) {
+    if(rows++ % 10 != 0)
+      return;
+
+    check_f(test_row, optimistic.exec(m, test_row.row_i));
+    check_f(test_row, pessimistic.exec(m, test_row.row_i));
+  });
+  ck_assert(below > 0 && above > 0);
+
+  test::performance::clear();
+}
+END_TEST
+
+std::vector<std::pair<roerei::dependency_id_t, float>> create_suggestions(roerei::dataset_t const& d, std::mt19937& gen)
+{
+  // Distinct scores, such that the order of the suggestions is well defined
+  std::vector<float> scores(d.dependencies.size());
+  std::iota(scores.begin(), scores.end(), 0.0f);
+  std::shuffle(scores.begin(), scores.end(), gen);
+
+  std::bernoulli_distribution dist(std::uniform_real_distribution<float>(0.0f, 1.0f)(gen));
+  std::vector<std::pair<roerei::dependency_id_t, float>> suggestions;
+  d.dependencies.keys([&](roerei::dependency_id_t i) {
+    if(dist(gen))
+      suggestions.emplace_back(i, scores[i.unseal()]);
+  });
+  std::shuffle(suggestions.begin(), suggestions.end(), gen);
+  return suggestions;
+}
+
+START_TEST(test_measure_metrics)
+{
+  roerei::test::performance::init();
+
+  auto const d(create_dataset(500, 10));
+  roerei::performance::measure_buffer_t buffer(d);
+
+  std::mt19937 gen(1337);
+  d.objects.keys([&](roerei::object_id_t i) {
+    auto const suggestions(create_suggestions(d, gen));
+    ck_assert(roerei::performance::measure_metrics(d, i, suggestions, buffer) == roerei::performance::measure(d, i, suggestions).metrics);
+  });
+
+  roerei::test::performance::clear();
+}
+END_TEST
+
+// Quadratic implementation of performance::compute_auc before it was rewritten as a single pass
+float compute_auc_reference(float c_required, std::vector<roerei::dependency_id_t> const& found_deps, std::vector<std::pair<roerei::dependency_id_t, float>> const& suggestions_sorted)
+{
+  std::map<roerei::dependency_id_t, size_t> suggestions_ranks;
+  std::vector<roerei::dependency_id_t> irrelevant_deps;
+  for(size_t j = 0; j < suggestions_sorted.size(); ++j)
+  {
+    suggestions_ranks[suggestions_sorted[j].first] = j;
+    if(!std::binary_search(found_deps.begin(), found_deps.end(), suggestions_sorted[j].first))
+      irrelevant_deps.emplace_back(suggestions_sorted[j].first);
+  }
+
+  if(c_required == 0)
+    return 1.0f;
+
+  if(irrelevant_deps.empty())
+    return 1.0f;
+
+  if(found_deps.empty())
+    return 0.0f;
+
+  float auc_sum = 0.0f;
+  for(roerei::dependency_id_t i : found_deps)
+    for(roerei::dependency_id_t j : irrelevant_deps)
+      if(suggestions_ranks[i] < suggestions_ranks[j])
+        auc_sum += 1.0f;
+
+  return auc_sum / static_cast<float>(found_deps.size() * irrelevant_deps.size());
+}
+
+START_TEST(test_compute_auc)
+{
+  roerei::test::performance::init();
+
+  std::mt19937 gen(1337);
+  for(size_t n = 0; n < 300; ++n)
+  {
+    std::vector<std::pair<roerei::dependency_id_t, float>> suggestions;
+    for(size_t j = 0; j < n; ++j)
+      suggestions.emplace_back(roerei::dependency_id_t(j), std::uniform_int_distribution<int>(0, 10)(gen));
+    roerei::performance::sort(suggestions);
+
+    std::bernoulli_distribution dist(std::uniform_real_distribution<float>(0.0f, 1.0f)(gen));
+    std::vector<roerei::dependency_id_t> found_deps;
+    for(size_t j = 0; j < n; ++j)
+      if(dist(gen))
+        found_deps.emplace_back(j);
+
+    float const c_required = found_deps.size() + std::uniform_int_distribution<size_t>(0, 3)(gen);
+    ck_assert(roerei::performance::compute_auc(c_required, found_deps, suggestions) == compute_auc_reference(c_required, found_deps, suggestions));
+  }
+
+  roerei::test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_quantile_sketch)
+{
+  std::mt19937 gen(1337);
+  std::lognormal_distribution<double> dist(3.0, 2.0);
+
+  std::vector<double> xs;
+  roerei::quantile_sketch_t sketch, lhs, rhs;
+  for(size_t i = 0; i < 10000; ++i)
+  {
+    double x = i % 10 == 0 ? 0.0 : dist(gen);
+    xs.emplace_back(x);
+    sketch.add(x);
+    (i % 2 == 0 ? lhs : rhs).add(x);
+  }
+  lhs += rhs;
+
+  std::sort(xs.begin(), xs.end());
+  for(double q : {0.0, 0.05, 0.1, 0.5, 0.9, 0.99, 1.0})
+  {
+    double const exact = xs[static_cast<size_t>(q * (xs.size() - 1))];
+    ck_assert(std::abs(sketch.quantile(q) - exact) <= roerei::quantile_sketch_t::default_alpha * exact + 1e-12);
+    ck_assert(sketch.quantile(q) == lhs.quantile(q));
+  }
+}
+END_TEST
+
+START_TEST(test_metrics_accumulator)
+{
+  std::mt19937 gen(1337);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+  roerei::performance::metrics_t sum;
+  roerei::performance::metrics_accumulator_t acc, lhs, rhs;
+  for(size_t i = 0; i < 1000; ++i)
+  {
+    roerei::performance::metrics_t const m(dist(gen), dist(gen), dist(gen), 100.0f * dist(gen), 100.0f * dist(gen), dist(gen), dist(gen));
+    sum += m;
+    acc += m;
+    (i < 300 ? lhs : rhs) += m;
+  }
+  lhs += rhs;
+
+  ck_assert(acc.metrics() == lhs.metrics());
+  ck_assert(acc.metrics().n == 1000);
+  check_metrics_drift(acc.metrics(), sum, 0.001f);
+  ck_assert(std::abs(acc.metrics().recall - sum.recall) <= 0.001f * sum.recall);
+}
+END_TEST
+
+START_TEST(test_trace)
+{
+  roerei::test::performance::init();
+
+  auto const d(create_dataset(300, 10));
+  std::string const path("roerei-test.trace");
+
+  std::mt19937 gen(1337);
+  std::vector<std::vector<std::pair<roerei::dependency_id_t, float>>> suggestions;
+  std::vector<roerei::performance::metrics_t> metrics;
+  {
+    roerei::trace::sink_t sink;
+    auto const file(sink.open(path, "test", 5));
+
+    roerei::performance::measure_buffer_t measure_buffer(d);
+    std::vector<std::pair<roerei::dependency_id_t, float>> buffer;
+    roerei::trace::block_t block;
+    d.objects.keys([&](roerei::object_id_t i) {
+      suggestions.emplace_back(create_suggestions(d, gen));
+      metrics.emplace_back(roerei::performance::measure_metrics(d, i, suggestions.back(), measure_buffer));
+      block.add(i.unseal() % 3, i, metrics.back(), suggestions.back(), file->top_n, buffer);
+
+      if(block.size() == 64)
+      {
+        sink.submit(file, std::move(block));
+        block = roerei::trace::block_t();
+      }
+    });
+    sink.submit(file, std::move(block));
+    sink.close(file);
+
+    // Traces are opened when their first block is written
+    std::remove((path + ".empty").c_str());
+    sink.close(sink.open(path + ".empty", "empty", 5));
+    sink.flush();
+  }
+  ck_assert(!std::ifstream(path + ".empty"));
+
+  // Failing to write a trace is not lost in the writer thread
+  {
+    roerei::trace::sink_t sink;
+    auto const file(sink.open("roerei-test-missing/roerei-test.trace", "missing", 5));
+
+    std::vector<std::pair<roerei::dependency_id_t, float>> buffer;
+    roerei::trace::block_t block;
+    block.add(0, roerei::object_id_t(0), metrics[0], suggestions[0], file->top_n, buffer);
+    sink.submit(file, std::move(block));
+    sink.close(file);
+
+    bool thrown = false;
+    try
+    {
+      sink.flush();
+    } catch(std::runtime_error const&)
+    {
+      thrown = true;
+    }
+    ck_assert(thrown);
+  }
+
+  size_t row = 0;
+  roerei::trace::read(path, [&](std::string const& description, size_t top_n, roerei::trace::block_t const& block) {
+    ck_assert(description == "test");
+    ck_assert(top_n == 5);
+
+    size_t offset = 0;
+    for(size_t j = 0; j < block.size(); ++j, ++row)
+    {
+      ck_assert(block.row[j] == row);
+      ck_assert(block.fold[j] == row % 3);
+      ck_assert(block.rank[j] == metrics[row].rank);
+      ck_assert(block.auc[j] == metrics[row].auc);
+
+      auto xs(suggestions[row]);
+      roerei::performance::sort(xs);
+      ck_assert(block.suggestion_count[j] == std::min<size_t>(5, xs.size()));
+      for(size_t k = 0; k < block.suggestion_count[j]; ++k, ++offset)
+      {
+        ck_assert(block.suggestion_dependency[offset] == xs[k].first.unseal());
+        ck_assert(block.suggestion_score[offset] == xs[k].second);
+      }
+    }
+  });
+  ck_assert(row == 300);
+
+  // A resumed trace keeps the rows of the done folds, but not the torn block at its end
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    os.write("\x10\x00", 2);
+  }
+  {
+    roerei::trace::sink_t sink;
+    auto const file(sink.open(path, "test", 5, {0, 2}));
+
+    std::vector<std::pair<roerei::dependency_id_t, float>> buffer;
+    roerei::trace::block_t block;
+    block.add(1, roerei::object_id_t(1000), metrics[0], suggestions[0], file->top_n, buffer);
+    sink.submit(file, std::move(block));
+    sink.close(file);
+  }
+
+  size_t resumed_rows = 0;
+  roerei::trace::read(path, [&](std::string const&, size_t, roerei::trace::block_t const& block) {
+    size_t offset = 0;
+    for(size_t j = 0; j < block.size(); offset += block.suggestion_count[j], ++j, ++resumed_rows)
+    {
+      ck_assert((block.fold[j] == 1) == (block.row[j] == 1000));
+      if(block.row[j] == 1000)
+        continue;
+
+      auto xs(suggestions[block.row[j]]);
+      roerei::performance::sort(xs);
+      ck_assert(block.rank[j] == metrics[block.row[j]].rank);
+      ck_assert(block.suggestion_count[j] == std::min<size_t>(5, xs.size()));
+      ck_assert(block.suggestion_count[j] == 0 || block.suggestion_dependency[offset] == xs[0].first.unseal());
+    }
+  });
+  ck_assert(resumed_rows == 201);
+
+  std::remove(path.c_str());
+  roerei::test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_profiler)
+{
+  using namespace roerei;
+
+  auto const work_f([]() {
+    for(size_t i = 0; i < 100; ++i)
+    {
+      performance_scope("test_profiler_outer")
+      for(size_t j = 0; j < 2; ++j)
+      {
+        performance_scope("test_profiler_inner")
+      }
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for(size_t t = 0; t < 3; ++t)
+    threads.emplace_back(work_f);
+  for(auto& t : threads)
+    t.join(); // Merged on thread exit
+
+  work_f();
+  test::performance::clear(); // Merges the main thread
+
+  size_t outer = 0, inner = 0;
+  test::performance::iterate_merged([&](std::vector<std::string> const& path, test::performance::counters_t const& counters) {
+    if(path == std::vector<std::string>({"test_profiler_outer"}))
+    {
+      outer = counters.count;
+      ck_assert(counters.min <= counters.max);
+    }
+    else if(path == std::vector<std::string>({"test_profiler_outer", "test_profiler_inner"}))
+    {
+      inner = counters.count;
+
+      size_t histogram_count = 0;
+      for(uint64_t c : counters.histogram)
+        histogram_count += c;
+      ck_assert(histogram_count == counters.count);
+    }
+  });
+
+  ck_assert(outer == 400);
+  ck_assert(inner == 800);
+}
+END_TEST
+
+START_TEST(test_multitask_borrow) // Tasks borrow the workers which have no task left to start
+{
+  using namespace roerei;
+
+  ck_assert(multitask::borrow(5) == 5); // Outside of a multitask
+
+  size_t granted = 0, more = 1;
+  multitask m;
+  std::vector<std::packaged_task<void()>> tasks;
+  tasks.emplace_back([&]() {
+    // The other two workers become idle once they find no task to start
+    for(size_t attempt = 0; attempt < 1000 && granted < 2; ++attempt)
+    {
+      multitask::give_back(granted);
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      granted = multitask::borrow(4);
+    }
+
+    more = multitask::borrow(1);
+    multitask::give_back(granted + more);
+  });
+  m.add({std::move(tasks), std::packaged_task<void()>([]() {})});
+  m.run(3, true);
+
+  ck_assert(granted == 2);
+  ck_assert(more == 0);
+}
+END_TEST
+
+START_TEST(test_events)
+{
+  using namespace roerei;
+
+  std::string const path("roerei-test.events");
+  events::open(path);
+
+  multitask m;
+  std::vector<std::packaged_task<void()>> tasks;
+  for(size_t i = 0; i < 3; ++i)
+    tasks.emplace_back([]() {
+      events::emit(events::event_t("fold")("jobset", multitask::jobset())("name", "a \"quoted\"\\name\n")("rows_per_sec", 123456.789012345));
+    });
+  size_t const jobset = m.add({std::move(tasks), std::packaged_task<void()>([]() {})});
+  m.run(2, true);
+
+  events::close();
+  events::emit(events::event_t("ignored"));
+
+  std::map<std::string, size_t> counts;
+  std::ifstream is(path);
+  std::string line;
+  double time = 0.0;
+  while(std::getline(is, line))
+  {
+    boost::property_tree::ptree e;
+    std::stringstream ss(line);
+    boost::property_tree::read_json(ss, e);
+
+    ck_assert(e.get<double>("time") >= time);
+    time = e.get<double>("time");
+
+    std::string const type(e.get<std::string>("event"));
+    counts[type]++;
+    if(type != "run")
+      ck_assert(e.get<size_t>("jobset") == jobset);
+    if(type == "fold")
+    {
+      ck_assert(e.get<std::string>("name") == "a \"quoted\"\\name\n");
+      ck_assert(e.get<double>("rows_per_sec") == 123456.789012345); // Without losing digits
+    }
+    if(type == "task_end")
+      ck_assert(e.get<double>("duration") >= 0.0 && e.get<long>("peak_rss_kb") > 0);
+  }
+
+  ck_assert(counts["run"] == 1);
+  ck_assert(counts["task_start"] == 3);
+  ck_assert(counts["task_end"] == 3);
+  ck_assert(counts["fold"] == 3);
+  ck_assert(counts["jobset_end"] == 1);
+  ck_assert(counts.count("ignored") == 0);
+
+  std::remove(path.c_str());
+}
+END_TEST
+
+START_TEST(test_synthetic)
+{
+  using namespace roerei;
+
+  synthetic::params_t p;
+  p.objects = 2000;
+  p.features = 1000;
+  p.depth = 10;
+  auto const d(synthetic::generate(p));
+
+  ck_assert(d.objects.size() == 2000 && d.dependencies.size() == 2000);
+  ck_assert(d.prior_objects.size() == 200);
+  ck_assert(*d.prior_objects.rbegin() == object_id_t(199));
+
+  // Objects only depend on earlier layers, thus the longest chain follows the layers
+  std::vector<size_t> chain(d.objects.size(), 1);
+  size_t occurrences = 0;
+  d.dependency_matrix.citerate([&](dataset_t::dependency_matrix_t::const_row_proxy_t const& row) {
+    for(auto const& kvp : row)
+    {
+      ck_assert(kvp.first.unseal() < row.row_i.unseal());
+      chain[row.row_i.unseal()] = std::max(chain[row.row_i.unseal()], chain[kvp.first.unseal()] + 1);
+    }
+
+    ck_assert((row.row_i.unseal() < 200) == (row.nonempty_size() == 0));
+  });
+  size_t const longest = *std::max_element(chain.begin(), chain.end());
+  ck_assert(longest >= 5 && longest <= 10);
+
+  // Power law: the most frequent features dominate
+  std::vector<size_t> frequencies(d.features.size());
+  d.feature_matrix.citerate([&](dataset_t::feature_matrix_t::const_row_proxy_t const& row) {
+    ck_assert(row.nonempty_size() > 0);
+    for(auto const& kvp : row)
+    {
+      frequencies[kvp.first.unseal()]++;
+      occurrences++;
+    }
+  });
+  std::sort(frequencies.begin(), frequencies.end(), std::greater<size_t>());
+  ck_assert(frequencies[0] > 10 * frequencies[frequencies.size() / 2]);
+  ck_assert(std::accumulate(frequencies.begin(), frequencies.begin() + 100, size_t(0)) > occurrences / 2);
+
+  // Deterministic in the seed
+  auto const d2(synthetic::generate(p));
+  d.feature_matrix.citerate([&](dataset_t::feature_matrix_t::const_row_proxy_t const& row) {
+    auto const row2(d2.feature_matrix[row.row_i]);
+    ck_assert(std::equal(row.begin(), row.end(), row2.begin(), row2.end()));
+  });
+}
+END_TEST
+
+START_TEST(test_server)
+{
+  using namespace roerei;
+
+  test::performance::init();
+
+  synthetic::params_t p;
+  p.objects = 500;
+  p.features = 200;
+  auto const d(synthetic::generate(p));
+
+  // Queries with the features of existing objects
+  std::vector<std::string> queries;
+  d.feature_matrix.citerate([&](dataset_t::feature_matrix_t::const_row_proxy_t const& row) {
+    if(row.row_i.unseal() % 10 != 0)
+      return;
+
+    std::stringstream ss;
+    ss << 5;
+    for(auto const& kvp : row)
+      for(size_t i = 0; i < kvp.second; ++i)
+        ss << ' ' << d.features[kvp.first];
+    ss << " unknown:feature";
+    queries.emplace_back(ss.str());
+  });
+
+  auto answer_f = [&](ml_type ml, size_t threads, size_t batch_size) {
+    server::options_t opt;
+    opt.ml = ml;
+    opt.threads = threads;
+    opt.batch_size = batch_size;
+    server s(d, opt);
+
+    std::vector<std::future<std::string>> futures;
+    for(auto const& q : queries)
+      futures.emplace_back(s.submit(q));
+
+    std::vector<std::string> responses;
+    for(auto& f : futures)
+      responses.emplace_back(f.get());
+
+    ck_assert(s.submit("x y").get().compare(0, 6, "error ") == 0);
+    ck_assert(s.submit("stats").get().compare(0, 9, "requests ") == 0);
+    return responses;
+  };
+
+  auto const knn_single(answer_f(ml_type::knn, 1, 1));
+  ck_assert(answer_f(ml_type::knn, 3, 4) == knn_single); // Batching does not change the answers
+
+  for(auto const& r : knn_single)
+  {
+    std::stringstream ss(r);
+    std::string uri;
+    float score, previous = INFINITY;
+    size_t n = 0;
+    while(ss >> uri >> score)
+    {
+      ck_assert(uri.compare(0, 11, "synthetic:o") == 0);
+      ck_assert(score <= previous);
+      previous = score;
+      n++;
+    }
+    ck_assert(n == 5);
+  }
+
+  for(auto const& r : answer_f(ml_type::naive_bayes, 2, 4))
+    ck_assert(!r.empty() && r.compare(0, 6, "error ") != 0);
+
+  test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_nb_log_table)
+{
+  roerei::test::performance::init();
+
+  auto const d(roerei::posetcons_canonical::consistentize(create_dataset(300, 150)));
+  roerei::nb_preload_data_t const pld(d);
+  roerei::compact_sparse_matrix_t<roerei::object_id_t, roerei::feature_id_t, roerei::dataset_t::value_t> const m(d.feature_matrix);
+
+  auto const tables(std::make_shared<roerei::nb_log_tables_t<roerei::exact_log> const>(10.0f));
+
+  m.citerate([&](auto const& test_row) {
+    auto const trainset(roerei::posetcons_canonical::exec(m, test_row));
+    roerei::naive_bayes<decltype(trainset), roerei::exact_log> ml_table(10, -1, 2, d, pld, trainset);
+    roerei::naive_bayes<decltype(trainset), roerei::exact_log> ml_direct(10, -1, 2, d, pld, trainset, 0);
+    roerei::naive_bayes<decltype(trainset), roerei::exact_log> ml_shared(-1, 2, d, pld, tables, trainset);
+
+    auto const prediction(ml_table.predict(test_row, test_row.row_i));
+    ck_assert(prediction == ml_direct.predict(test_row, test_row.row_i));
+    ck_assert(prediction == ml_shared.predict(test_row, test_row.row_i));
+  });
+
+  roerei::test::performance::clear();
+}
+END_TEST
+
+START_TEST(test_serialize_dataset)
+{
+  using namespace roerei;
+
+  auto roundtrip = [](msgpack_serializer& s) {
+    std::string buf;
+    s.dump([&](const char* data, size_t len) {
+      buf.append(data, len);
+    });
+
+    msgpack_deserializer d;
+    d.feed(buf);
+    return deserialize<dataset_t>(d, "dataset");
+  };
+
+  auto matrix_eq = [](auto const& x, auto const& y) {
+    ck_assert(x.size_m() == y.size_m() && x.size_n() == y.size_n());
+    x.citerate([&](auto const& row) {
+      auto const other = y[row.row_i];
+      ck_assert(row.nonempty_size() == other.nonempty_size());
+      ck_assert(std::equal(row.begin(), row.end(), other.begin()));
+    });
+  };
+
+  dataset_t d(create_dataset(300, 50));
+  d.prior_objects = {object_id_t(1), object_id_t(7), object_id_t(299)};
+
+  msgpack_serializer s;
+  serialize(s, "dataset", d);
+  dataset_t const d2(roundtrip(s));
+
+  ck_assert(d2.objects == d.objects && d2.features == d.features && d2.dependencies == d.dependencies);
+  matrix_eq(d.feature_matrix, d2.feature_matrix);
+  matrix_eq(d.dependency_matrix, d2.dependency_matrix);
+  ck_assert(d2.prior_objects == d.prior_objects);
+  ck_assert(d2.dependency_objects[dependency_id_t(3)] == object_id_t(3));
+
+  // Files written before the bulk format, with a separate msgpack value per entry and prior object
+  msgpack_serializer s_old;
+  s_old.write_object("dataset", 6);
+  serialize(s_old, "objects", d.objects);
+  serialize(s_old, "features", d.features);
+  serialize(s_old, "dependencies", d.dependencies);
+  auto write_old_matrix = [&](std::string const& name, auto const& m) {
+    s_old.write_object(name, 3);
+    s_old.write("m", m.size_m());
+    s_old.write("n", m.size_n());
+    s_old.write_array("data", m.size_m());
+    m.citerate([&](auto const& row) {
+      s_old.write_array("row", row.nonempty_size());
+      for(auto const& kvp : row)
+      {
+        s_old.write_array("kvp", 2);
+        s_old.write("j", static_cast<uint64_t>(kvp.first.unseal()));
+        s_old.write("v", kvp.second);
+      }
+    });
+  };
+  write_old_matrix("feature_matrix", d.feature_matrix);
+  write_old_matrix("dependency_matrix", d.dependency_matrix);
+  s_old.write_array("prior_objects", d.prior_objects.size());
+  for(object_id_t i : d.prior_objects)
+    s_old.write("prior_objects_e", static_cast<uint64_t>(i.unseal()));
+
+  dataset_t const d3(roundtrip(s_old));
+  matrix_eq(d.feature_matrix, d3.feature_matrix);
+  matrix_eq(d.dependency_matrix, d3.dependency_matrix);
+  ck_assert(d3.prior_objects == d.prior_objects);
+}
+END_TEST
+
+START_TEST(test_append)
+{
+  using namespace roerei;
+
+  // Objects depend on earlier objects, on "t:r" which never gets an object, and on "t:q" which gets one later
+  auto object_uri = [](size_t i) {
+    char uri[16];
+    std::snprintf(uri, sizeof(uri), "t:o%02zu", i);
+    return std::string(uri);
+  };
+
+  auto summary = [&](size_t i) {
+    summary_t s;
+    s.corpus = "t";
+    s.uri = object_uri(i);
+    s.type_uris.push_back({"t:f" + std::to_string(i % 7), 1 + i % 2, 1});
+    s.type_uris.push_back({"t:g" + std::to_string((i * 3) % 11), 1, 2});
+    s.body_uris.reset(std::vector<summary_t::occurance_t>());
+    if(i == 0)
+      s.body_uris->push_back({"t:r", 1, 1});
+    else
+    {
+      s.body_uris->push_back({object_uri(i / 2), 1, 1});
+      s.body_uris->push_back({object_uri(i - 1), 1, 1});
+    }
+    if(i >= 15 && i % 3 == 0)
+      s.body_uris->push_back({"t:q", 1, 1});
+    return s;
+  };
+
+  std::vector<summary_t> old_summaries, new_summaries;
+  for(size_t i = 0; i < 30; ++i)
+    old_summaries.emplace_back(summary(i));
+  for(size_t i = 30; i < 40; ++i)
+    new_summaries.emplace_back(summary(i));
+
+  summary_t q_summary = summary(5);
+  q_summary.uri = "t:q";
+  q_summary.type_uris.push_back({"t:h", 1, 1});
+  new_summaries.emplace_back(q_summary);
+
+  auto construct = [](std::vector<summary_t> const& summaries) {
+    auto map(generator::construct([](auto) {}, [&](auto f) {
+      for(auto s : summaries)
+        f(std::move(s), false);
+    }, generator::variant_e::frequency));
+    return std::move(map.at("t"));
+  };
+
+  std::vector<summary_t> all_summaries(old_summaries);
+  all_summaries.insert(all_summaries.end(), new_summaries.begin(), new_summaries.end());
+  dataset_t const d_full(construct(all_summaries));
+
+  dataset_t d(construct(old_summaries));
+  ck_assert(d.objects.size() == 30 && d.dependencies.size() == 31);
+
+  uint64_t const fingerprint = d.fingerprint();
+  object_id_t const first(generator::append(d, std::vector<summary_t>(new_summaries), std::map<uri_t, uri_t>(), generator::variant_e::frequency));
+  ck_assert(d.fingerprint() != fingerprint);
+  ck_assert(first == object_id_t(30));
+  ck_assert(d.objects.size() == d_full.objects.size() && d.objects.size() == 41);
+  ck_assert(d.features.size() == d_full.features.size());
+  ck_assert(d.dependencies.size() == d_full.dependencies.size());
+
+  // Same rows as a full construction, modulo the order of the ids
+  auto uri_row = [](auto const& row, auto const& uris) {
+    std::map<uri_t, dataset_t::value_t> result;
+    for(auto const& kvp : row)
+      result[uris[kvp.first]] = kvp.second;
+    return result;
+  };
+
+  std::map<uri_t, object_id_t> const full_objects(create_map(d_full.objects));
+  d.objects.iterate([&](object_id_t i, uri_t const& u) {
+    object_id_t const j = full_objects.at(u);
+    ck_assert(uri_row(d.feature_matrix[i], d.features) == uri_row(d_full.feature_matrix[j], d_full.features));
+    ck_assert(uri_row(d.dependency_matrix[i], d.dependencies) == uri_row(d_full.dependency_matrix[j], d_full.dependencies));
+  });
+
+  // Existing objects are not appended again
+  uint64_t const appended_fingerprint = d.fingerprint();
+  ck_assert(generator::append(d, std::vector<summary_t>(new_summaries), std::map<uri_t, uri_t>(), generator::variant_e::frequency) == object_id_t(41));
+  ck_assert(d.fingerprint() == appended_fingerprint);
+  ck_assert(d.objects.size() == 41);
+}
+END_TEST
+
+START_TEST(test_results_store)
+{
+  using namespace roerei;
+
+  std::string const path("roerei-test.results");
+  std::remove(path.c_str());
+
+  auto result = [](size_t k, float rank) {
+    cv_result_t r;
+    r.corpus = "test";
+    r.prior = true;
+    r.strat = posetcons_type::canonical;
+    r.ml = ml_type::knn;
+    r.knn_params = knn_params_t({k});
+    r.n = 1;
+    r.k = 10;
+    r.metrics.rank = rank;
+    return r;
+  };
+
+  auto count = [&]() {
+    size_t n = 0;
+    results_store(path).iterate([&](cv_result_t const&) { n++; });
+    return n;
+  };
+
+  // Files written before the records, with bare results
+  {
+    msgpack_serializer s;
+    serialize(s, "cv_result_v2", result(1, 1.0f));
+    serialize(s, "cv_result_v2", result(2, 2.0f));
+    std::ofstream os(path, std::ios::binary);
+    s.dump([&](const char* data, size_t len) {
+      os.write(data, len);
+    });
+  }
+
+  {
+    results_store store(path);
+    ck_assert(store.contains(results_store::key(result(1, 0.0f))));
+    ck_assert(!store.contains(results_store::key(result(3, 0.0f))));
+
+    store.add(result(3, 3.0f));
+    store.add(result(1, 4.0f)); // Supersedes the first
+    store.flush();
+    ck_assert(store.find(results_store::key(result(1, 0.0f)))->metrics.rank == 4.0f);
+  }
+
+  {
+    results_store store(path);
+    ck_assert(store.contains(results_store::key(result(3, 0.0f))));
+    ck_assert(store.find(results_store::key(result(1, 0.0f)))->metrics.rank == 4.0f);
+  }
+  ck_assert(count() == 4);
+
+  // A torn record is ignored, and replaced by the next
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    os.write("\xc5\x01\x00\x92", 4);
+  }
+  ck_assert(count() == 4);
+
+  {
+    results_store store(path);
+    store.add(result(4, 5.0f));
+  }
+  ck_assert(count() == 5);
+  ck_assert(results_store(path).contains(results_store::key(result(4, 0.0f))));
+
+  // Erased results are dropped from the file, and later results are appended after the others
+  {
+    results_store store(path);
+    store.erase_if([](cv_result_t const& r) { return r.knn_params->k == 1; });
+    ck_assert(!store.contains(results_store::key(result(1, 0.0f))));
+    store.add(result(5, 6.0f));
+    store.flush();
+  }
+  ck_assert(count() == 4);
+  {
+    results_store store(path);
+    ck_assert(!store.contains(results_store::key(result(1, 0.0f))));
+    ck_assert(store.find(results_store::key(result(5, 0.0f)))->metrics.rank == 6.0f);
+  }
+
+  std::remove(path.c_str());
+}
+END_TEST
+
+START_TEST(test_cv_checkpoint)
+{
+  using namespace roerei;
+
+  dataset_t const d(create_dataset(300, 50));
+  cv const c(d, 4, 1, 1337);
+  ck_assert(c.folds() == 4);
+
+  // Suggests the dependencies of the row itself, in part
+  auto init_f = [&](cv::trainset_t const&) {
+    return [&](cv::testrow_t const& test_row) {
+      std::vector<std::pair<dependency_id_t, float>> suggestions;
+      for(auto const& kvp : d.dependency_matrix[test_row.row_i])
+        if(kvp.first.unseal() % 2 == 0)
+          suggestions.emplace_back(kvp.first, 1.0f);
+      suggestions.emplace_back(dependency_id_t(0), 0.5f);
+      return suggestions;
+    };
+  };
+
+  std::mutex mutex;
+  auto run = [&](std::map<size_t, performance::metrics_t> const& done, std::map<size_t, performance::metrics_t>& run_folds, boost::optional<performance::metrics_t>& total) {
+    cv::checkpoint_t checkpoint;
+    checkpoint.done = done;
+    checkpoint.fold_f = [&](size_t fold, performance::metrics_t const& metrics) {
+      std::lock_guard<std::mutex> lock(mutex);
+      run_folds.emplace(fold, metrics);
+    };
+
+    multitask m;
+    c.order_async(m, init_f, [&](performance::metrics_t const& metrics) { total = metrics; }, d, true, true, "checkpoint", nullptr, std::string(), checkpoint);
+    m.run(2, true);
+  };
+
+  std::map<size_t, performance::metrics_t> folds;
+  boost::optional<performance::metrics_t> total;
+  run({}, folds, total);
+  ck_assert(folds.size() == 4 && total);
+
+  // Only the missing folds are run, and the result is the same
+  std::map<size_t, performance::metrics_t> resumed_folds;
+  boost::optional<performance::metrics_t> resumed_total;
+  run({{0, folds.at(0)}, {2, folds.at(2)}}, resumed_folds, resumed_total);
+  ck_assert(resumed_folds.size() == 2 && resumed_folds.count(1) && resumed_folds.count(3));
+  ck_assert(resumed_total && resumed_total->n == total->n);
+  ck_assert(std::abs(resumed_total->rank - total->rank) <= 1e-4f * total->rank);
+  ck_assert(std::abs(resumed_total->auc - total->auc) <= 1e-4f);
+
+  // Without any missing folds the result is yielded at once
+  std::map<size_t, performance::metrics_t> no_folds;
+  boost::optional<performance::metrics_t> done_total;
+  run(folds, no_folds, done_total);
+  ck_assert(no_folds.empty() && done_total && done_total->n == total->n);
+}
+END_TEST
+
 Suite* roerei_suite(void)
 {
 	Suite* s = suite_create("roerei");
@@ -316,12 +1577,36 @@ Suite* roerei_suite(void)
 
 	tcase_add_test(tc_core, test_matrix_arr_eq);
 	tcase_add_test(tc_core, test_matrix_iter_eq);
+	tcase_add_test(tc_core, test_matrix_builder_eq);
 	tcase_add_test(tc_core, test_sliced_matrix_iter_eq);
 	tcase_add_test(tc_core, test_compact_matrix_iter_eq);
+	tcase_add_test(tc_core, test_try_row);
+	tcase_add_test(tc_core, test_row_mask);
+	tcase_add_test(tc_core, test_ranged_citerate);
   tcase_add_test(tc_core, test_sparse_unit_matrix_transitive);
   tcase_add_test(tc_core, test_sparse_unit_matrix_non_cyclic);
   tcase_add_test(tc_core, test_topological_sort);
   tcase_add_test(tc_core, test_transitive);
+  tcase_add_test(tc_core, test_approximate_log_error);
+  tcase_add_test(tc_core, test_approximate_log_metrics_drift);
+  tcase_add_test(tc_core, test_nb_log_table);
+  tcase_add_test(tc_core, test_adarank_threads);
+  tcase_add_test(tc_core, test_adarank_requirements);
+  tcase_add_test(tc_core, test_measure_metrics);
+  tcase_add_test(tc_core, test_compute_auc);
+  tcase_add_test(tc_core, test_quantile_sketch);
+  tcase_add_test(tc_core, test_metrics_accumulator);
+  tcase_add_test(tc_core, test_trace);
+  tcase_add_test(tc_core, test_profiler);
+  tcase_add_test(tc_core, test_multitask_borrow);
+  tcase_add_test(tc_core, test_events);
+  tcase_add_test(tc_core, test_synthetic);
+  tcase_add_test(tc_core, test_server);
+  tcase_add_test(tc_core, test_append);
+  tcase_add_test(tc_core, test_index_uris);
+  tcase_add_test(tc_core, test_serialize_dataset);
+  tcase_add_test(tc_core, test_results_store);
+  tcase_add_test(tc_core, test_cv_checkpoint);
 
 	suite_add_tcase(s, tc_core);
 